@@ -1,7 +1,228 @@
 #include<iostream>
 #include<algorithm>
+#include<new>
+#include<vector>
+#include<string>
+#include<sstream>
+#include<cstring>
+#include<cstdlib>
+#include<thread>
+#include<mutex>
+#include<condition_variable>
+#include<functional>
+#include<future>
+#include<atomic>
+#include<map>
+#include<tuple>
+#include<memory>
+#if defined(__x86_64__) || defined(__i386__)
+#include<immintrin.h>
+#define HAVE_X86_KERNELS
+#endif
 using namespace std;
 
+/*============================================================================
+ *  Struct:     Kernels
+ *  Purpose:    Row reductions used by MOD and row addition used by MADD;
+ *              best() picks AVX2 or SSE2 versions at runtime and the
+ *              scalar() versions are kept as the reference
+ * ==========================================================================*/
+struct Kernels {
+    int (*rowMax)(const int* a, int n);
+    int (*rowMin)(const int* a, int n);
+    int (*rowSum)(const int* a, int n);
+    void (*addRow)(int* to, const int* from, int n);
+
+    static const Kernels& scalar();
+    static const Kernels& best();
+
+    /* Runs both versions on every row of the n x n grids A and B (rows stride apart), and reports any row where */
+    /* they differ on cerr; returns whether they all agree */
+    static bool check(const int* A, const int* B, int n, int stride);
+};
+
+/* Sums wrap around modulo 2^32, same as the vector adds, so every version gives bit-identical results */
+static int scalarRowMax(const int* a, int n) {
+    int output=a[0];
+    for(int i=1; i<n; i++)
+        output=max(output, a[i]);
+    return output;
+}
+
+static int scalarRowMin(const int* a, int n) {
+    int output=a[0];
+    for(int i=1; i<n; i++)
+        output=min(output, a[i]);
+    return output;
+}
+
+static int scalarRowSum(const int* a, int n) {
+    unsigned output=0;
+    for(int i=0; i<n; i++)
+        output+=a[i];
+    return (int)output;
+}
+
+static void scalarAddRow(int* to, const int* from, int n) {
+    for(int i=0; i<n; i++)
+        to[i]=(int)((unsigned)to[i]+(unsigned)from[i]);
+}
+
+#ifdef HAVE_X86_KERNELS
+/* SSE2 has no packed signed min/max for 32 bit lanes, so we select with a comparison mask */
+static inline __m128i sse2Max(__m128i a, __m128i b) {
+    __m128i mask=_mm_cmpgt_epi32(a, b);
+    return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+
+static inline __m128i sse2Min(__m128i a, __m128i b) {
+    __m128i mask=_mm_cmpgt_epi32(a, b);
+    return _mm_or_si128(_mm_and_si128(mask, b), _mm_andnot_si128(mask, a));
+}
+
+static int sse2RowMax(const int* a, int n) {
+    if(n<4) return scalarRowMax(a, n);
+    __m128i best=_mm_loadu_si128((const __m128i*)a);
+    int i=4;
+    for(; i+4<=n; i+=4)
+        best=sse2Max(best, _mm_loadu_si128((const __m128i*)(a+i)));
+
+    /* Reduce the lanes, then take care of the leftover elements */
+    int lanes[4];
+    _mm_storeu_si128((__m128i*)lanes, best);
+    int output=scalarRowMax(lanes, 4);
+    for(; i<n; i++)
+        output=max(output, a[i]);
+    return output;
+}
+
+static int sse2RowMin(const int* a, int n) {
+    if(n<4) return scalarRowMin(a, n);
+    __m128i best=_mm_loadu_si128((const __m128i*)a);
+    int i=4;
+    for(; i+4<=n; i+=4)
+        best=sse2Min(best, _mm_loadu_si128((const __m128i*)(a+i)));
+
+    int lanes[4];
+    _mm_storeu_si128((__m128i*)lanes, best);
+    int output=scalarRowMin(lanes, 4);
+    for(; i<n; i++)
+        output=min(output, a[i]);
+    return output;
+}
+
+static int sse2RowSum(const int* a, int n) {
+    __m128i total=_mm_setzero_si128();
+    int i=0;
+    for(; i+4<=n; i+=4)
+        total=_mm_add_epi32(total, _mm_loadu_si128((const __m128i*)(a+i)));
+
+    int lanes[4];
+    _mm_storeu_si128((__m128i*)lanes, total);
+    return (int)((unsigned)scalarRowSum(lanes, 4)+(unsigned)scalarRowSum(a+i, n-i));
+}
+
+static void sse2AddRow(int* to, const int* from, int n) {
+    int i=0;
+    for(; i+4<=n; i+=4) {
+        __m128i sum=_mm_add_epi32(_mm_loadu_si128((const __m128i*)(to+i)), _mm_loadu_si128((const __m128i*)(from+i)));
+        _mm_storeu_si128((__m128i*)(to+i), sum);
+    }
+    scalarAddRow(to+i, from+i, n-i);
+}
+
+__attribute__((target("avx2"))) static int avx2RowMax(const int* a, int n) {
+    if(n<8) return sse2RowMax(a, n);
+    __m256i best=_mm256_loadu_si256((const __m256i*)a);
+    int i=8;
+    for(; i+8<=n; i+=8)
+        best=_mm256_max_epi32(best, _mm256_loadu_si256((const __m256i*)(a+i)));
+
+    int lanes[8];
+    _mm256_storeu_si256((__m256i*)lanes, best);
+    int output=scalarRowMax(lanes, 8);
+    for(; i<n; i++)
+        output=max(output, a[i]);
+    return output;
+}
+
+__attribute__((target("avx2"))) static int avx2RowMin(const int* a, int n) {
+    if(n<8) return sse2RowMin(a, n);
+    __m256i best=_mm256_loadu_si256((const __m256i*)a);
+    int i=8;
+    for(; i+8<=n; i+=8)
+        best=_mm256_min_epi32(best, _mm256_loadu_si256((const __m256i*)(a+i)));
+
+    int lanes[8];
+    _mm256_storeu_si256((__m256i*)lanes, best);
+    int output=scalarRowMin(lanes, 8);
+    for(; i<n; i++)
+        output=min(output, a[i]);
+    return output;
+}
+
+__attribute__((target("avx2"))) static int avx2RowSum(const int* a, int n) {
+    __m256i total=_mm256_setzero_si256();
+    int i=0;
+    for(; i+8<=n; i+=8)
+        total=_mm256_add_epi32(total, _mm256_loadu_si256((const __m256i*)(a+i)));
+
+    int lanes[8];
+    _mm256_storeu_si256((__m256i*)lanes, total);
+    return (int)((unsigned)scalarRowSum(lanes, 8)+(unsigned)scalarRowSum(a+i, n-i));
+}
+
+__attribute__((target("avx2"))) static void avx2AddRow(int* to, const int* from, int n) {
+    int i=0;
+    for(; i+8<=n; i+=8) {
+        __m256i sum=_mm256_add_epi32(_mm256_loadu_si256((const __m256i*)(to+i)), _mm256_loadu_si256((const __m256i*)(from+i)));
+        _mm256_storeu_si256((__m256i*)(to+i), sum);
+    }
+    scalarAddRow(to+i, from+i, n-i);
+}
+#endif
+
+const Kernels& Kernels::scalar() {
+    static const Kernels kernels={scalarRowMax, scalarRowMin, scalarRowSum, scalarAddRow};
+    return kernels;
+}
+
+const Kernels& Kernels::best() {
+#ifdef HAVE_X86_KERNELS
+    /* SSE2 is always present on x86-64; AVX2 is detected with CPUID */
+    static const Kernels sse2={sse2RowMax, sse2RowMin, sse2RowSum, sse2AddRow};
+    static const Kernels avx2={avx2RowMax, avx2RowMin, avx2RowSum, avx2AddRow};
+    static const Kernels& chosen= __builtin_cpu_supports("avx2") ? avx2 : sse2;
+    return chosen;
+#else
+    return scalar();
+#endif
+}
+
+/* Every row is also tried from its fourth element, so that unaligned starts and other tail lengths are covered */
+bool Kernels::check(const int* A, const int* B, int n, int stride) {
+    const Kernels &reference=scalar(), &fast=best();
+    vector<int> expected(n), got(n);
+    bool agree=true;
+    for(int i=0; i<n; i++) {
+        const int* a=A+(size_t)i*stride;
+        const int* b=B+(size_t)i*stride;
+        for(int skip: {0, min(3, n-1)}) {
+            int length=n-skip;
+            copy(a+skip, a+n, expected.begin());
+            copy(a+skip, a+n, got.begin());
+            reference.addRow(expected.data(), b+skip, length);
+            fast.addRow(got.data(), b+skip, length);
+            if(reference.rowMax(a+skip, length)!=fast.rowMax(a+skip, length) || reference.rowMin(a+skip, length)!=fast.rowMin(a+skip, length)
+                    || reference.rowSum(a+skip, length)!=fast.rowSum(a+skip, length) || expected!=got) {
+                cerr<<"Kernel mismatch on row "<<i<<" (from column "<<skip<<")"<<endl;
+                agree=false;
+            }
+        }
+    }
+    return agree;
+}
+
 /*============================================================================
  *  Class:      Matrix
  *  Purpose:    Hold grid data and provide 
@@ -9,161 +230,607 @@ using namespace std;
  * ==========================================================================*/
 class Matrix {
     public:
-        /* Constructor takes size and pointer to matrix as inputs and initializes private variables */
-        Matrix(int n, int** A): size(n), grid(A) {}
+        /* Constructor takes size and pointer to a grid obtained from allocateGrid(n) and initializes private variables */
+        /* The kernels default to the fastest ones this cpu supports; passing Kernels::scalar() gives the reference path */
+        Matrix(int n, int* A, const Kernels& k=Kernels::best()): size(n), stride(paddedStride(n)), grid(A), kernels(k) {}
+
+        /* Rows are padded so that every row starts on a cache line; element (i, j) is at A[i*paddedStride(n)+j] */
+        static int paddedStride(int n);
+        static int* allocateGrid(int n);
 
         /* The following functions perform operations as described by assignment description */
-        void SPSUM();
-        void MOD();
-        void MRS(Matrix&, int k);
-        void MADD(Matrix&, int x);
+        void SPSUM(ostream& out=cout);
+        void MOD(ostream& out=cout);
+        void MRS(Matrix&, int k, ostream& out=cout);
+        void MRS(Matrix&, const int* shifts, int count, ostream& out=cout);
+        void MADD(Matrix&, int x, ostream& out=cout);
+
+        /* The following functions do the work of the operations above for the rows [low, high) only, */
+        /* so that a single query can be split among threads; the grids are never written to */
+        void SPSUMRows(int low, int high, int* sum);
+        void printSPSUM(const int* sum, ostream& out);
+        long long MODRows(int low, int high);
+        void MADDRows(Matrix&, int x, int low, int high, ostream& out);
+        void linearSumRows(Matrix&, int* sum, int low, int high);
+        void MRSRows(const int* sum, int k, int low, int high, ostream& out);
+
+        /* Returns the number of rows (and columns) */
+        int dimension() { return size; }
+
+        /* The grid never changes, so the printed result of a query can be kept and reused; other is the second */
+        /* matrix of MRS and MADD; lookup returns NULL if the result has not been kept, and counts hits and misses; */
+        /* countRepeat counts a hit on a result that is being worked out right now. Kept results are shared, not copied */
+        shared_ptr<const string> lookup(const string& command, int argument, Matrix* other);
+        void remember(const string& command, int argument, Matrix* other, const shared_ptr<const string>& text);
+        void countRepeat() { hits++; }
+
+        /* Whether a result of this many bytes could be kept at all */
+        static bool fitsCache(size_t bytes) { return bytes<=CACHE_BYTES; }
+        long long cacheHits() { return hits; }
+        long long cacheMisses() { return misses; }
+
+        /* Starts computing SPSUM and MOD in the background; lookups of those wait for it to finish */
+        void precompute();
+
+        /* Side of the square tiles used when a row of the result needs a column of the grid */
+        static const int TILE=64;
 
     private:
-        int size;
-        int** grid;
+        /* Returns pointer to the beginning of row i */
+        int* row(int i) { return grid+(size_t)i*stride; }
+
+        /* The grid is one contiguous, cache line aligned, row-major buffer of size rows of length stride */
+        int size, stride;
+        int* grid;
+
+        /* Row kernels used by MOD and MADD */
+        const Kernels& kernels;
+
+        /* Queries that give the same output map to the same key: the shift of MRS is taken modulo size*size, */
+        /* and MADD with any x other than 1 transforms the second matrix */
+        typedef tuple<string, long long, Matrix*> cacheKey;
+        cacheKey key(const string& command, int argument, Matrix* other);
+
+        /* Results are kept until they add up to CACHE_BYTES, after which new ones are not stored */
+        static const size_t CACHE_BYTES=1<<28;
+        map<cacheKey, shared_ptr<const string> > cache;
+        size_t cachedBytes=0;
+        atomic<long long> hits{0}, misses{0};
+        mutex cacheLock;
+
+        /* Declared last, so that it is waited on before the rest of the object goes away */
+        shared_future<void> background;
 };
 
-void Matrix::SPSUM() {
-    /* Here we sum the modified rows and print */
+int Matrix::paddedStride(int n) {
+    /* 16 ints make up one 64 byte cache line */
+    return (n+15)/16*16;
+}
+
+int* Matrix::allocateGrid(int n) {
+    return new(align_val_t(64)) int[(size_t)n*paddedStride(n)];
+}
+
+Matrix::cacheKey Matrix::key(const string& command, int argument, Matrix* other) {
+    long long total=(long long)size*size;
+    if(command.compare("MRS")==0)
+        return cacheKey(command, ((argument%total)+total)%total, other);
+    if(command.compare("MADD")==0)
+        return cacheKey(command, argument==1 ? 1 : 2, other);
+    return cacheKey(command, 0, NULL);
+}
+
+shared_ptr<const string> Matrix::lookup(const string& command, int argument, Matrix* other) {
+    if(background.valid() && (command.compare("SPSUM")==0 || command.compare("MOD")==0))
+        background.wait();
+
+    lock_guard<mutex> lock(cacheLock);
+    auto it=cache.find(key(command, argument, other));
+    if(it==cache.end()) {
+        misses++;
+        return NULL;
+    }
+    hits++;
+    return it->second;
+}
+
+void Matrix::remember(const string& command, int argument, Matrix* other, const shared_ptr<const string>& text) {
+    lock_guard<mutex> lock(cacheLock);
+    if(cachedBytes+text->size()>CACHE_BYTES)
+        return;
+    if(cache.insert(make_pair(key(command, argument, other), text)).second)
+        cachedBytes+=text->size();
+}
+
+void Matrix::precompute() {
+    background=async(launch::async, [this]() {
+        ostringstream spsum, mod;
+        SPSUM(spsum);
+        MOD(mod);
+        remember("SPSUM", 0, NULL, make_shared<const string>(spsum.str()));
+        remember("MOD", 0, NULL, make_shared<const string>(mod.str()));
+    }).share();
+}
+
+void Matrix::SPSUM(ostream& out) {
+    int* sum=new int[size]();
+    SPSUMRows(0, size, sum);
+    printSPSUM(sum, out);
+    delete[] sum;
+}
+
+/* Adds the contributions of grid rows [low, high) to the modified row sums */
+void Matrix::SPSUMRows(int low, int high, int* sum) {
+    /* The (r, c)th element of the grid goes to row r of the modified matrix if r+c is even, else to row c */
+    /* So a single row-major pass over the grid fills all row sums, without ever walking down a column */
+    for(int r=low; r<high; r++) {
+        int* current=row(r);
+        for(int c=0; c<size; c++)
+            ((r+c)%2==0 ? sum[r] : sum[c])+=current[c];
+    }
+}
+
+void Matrix::printSPSUM(const int* sum, ostream& out) {
+    /* Here we print the modified row sums */
     for(int i=0; i<size; i++) {
-        int sum=0;
-        for(int j=0; j<size; j++) {
-            /* This condition chooses the correct modified value of the (i, j)th element */
-            if((i+j)%2==0)
-                sum+=grid[i][j];
-            else 
-                sum+=grid[j][i];
-        }
-        cout<<sum;
+        out<<sum[i];
 
         /* We print newline in the last iteration */
-        cout<<(i==size-1 ? "\n" : ",");
+        out<<(i==size-1 ? "\n" : ",");
     }
 }
 
-void Matrix::MOD() {
+void Matrix::MOD(ostream& out) {
+    out<<MODRows(0, size)<<endl;
+}
+
+/* Returns the product of the row results of rows [low, high) */
+long long Matrix::MODRows(int low, int high) {
     /* Output hold the product of the results of each row - careful about overflow!!*/
-    long long output=1;
+    /* The product is taken modulo 2^64, so products of separate row ranges multiply to the same answer */
+    unsigned long long output=1;
 
-    for(int i=0; i<size; i++) {
+    for(int i=low; i<high; i++) {
         /* rowOutput stores the result of the the operation on a particular row, to be multiplied with total output */
         int rowOutput=0;
         if(i%3==0) {
 
             /* If i is divisible by 3, we need to find maximum of the row */
-            rowOutput=grid[i][0];
-            for(int j=1; j<size; j++)
-                rowOutput=max(rowOutput, grid[i][j]);
+            rowOutput=kernels.rowMax(row(i), size);
         } else if(i%3==1) {
 
             /* If i gives remainder of 1, we need to find minimum of the row */
-            rowOutput=grid[i][0];
-            for(int j=1; j<size; j++)
-                rowOutput=min(rowOutput, grid[i][j]);
+            rowOutput=kernels.rowMin(row(i), size);
         } else {
 
             /* If i gives remainder of 2, we need to get floored average */
-            rowOutput=0;
-            for(int j=0; j<size; j++)
-                rowOutput+=grid[i][j];
-            rowOutput/=size;
+            rowOutput=kernels.rowSum(row(i), size)/size;
         }
         /* Updating the total output */
-        output*=rowOutput;
+        output*=(long long)rowOutput;
     }
-    cout<<output<<endl;
+    return (long long)output;
 }
 
 /* Here, second is the other matrix in the operation, and k is number of shifts */
-void Matrix::MRS(Matrix& second, int k) {
+void Matrix::MRS(Matrix& second, int k, ostream& out) {
+    MRS(second, &k, 1, out);
+}
+
+/* Answers count shift queries, in the given order, with a single pass over both matrices */
+void Matrix::MRS(Matrix& second, const int* shifts, int count, ostream& out) {
+    /* Shifting both matrices and adding is the same as adding and then shifting, so we form the sum once, in linear form */
+    int* sum=new int[(size_t)size*size];
+    linearSumRows(second, sum, 0, size);
+
+    for(int q=0; q<count; q++)
+        MRSRows(sum, shifts[q], 0, size, out);
+    delete[] sum;
+}
+
+/* Writes rows [low, high) of this matrix plus second into sum, as one array of size*size elements */
+void Matrix::linearSumRows(Matrix& second, int* sum, int low, int high) {
+    for(int i=low; i<high; i++) {
+        copy(row(i), row(i)+size, sum+(size_t)i*size);
+        kernels.addRow(sum+(size_t)i*size, second.row(i), size);
+    }
+}
+
+/* Prints rows [low, high) of the linear sum shifted by k */
+void Matrix::MRSRows(const int* sum, int k, int low, int high, ostream& out) {
+    size_t total=(size_t)size*size;
 
     /* Shifts which are multiples of n*n bring matrix back to original position */
-    k%=size*size;
+    size_t shift=((k%(long long)total)+total)%total;
 
-    /* Printing sum of shifted matrices */
-    for(int i=0; i<size; i++) {
+    /* Linear position p of the shifted matrix holds element p-k of the original, so we find where row low */
+    /* starts in the sum once, and from there on just walk forward, wrapping around at the end */
+    size_t source=((size_t)low*size+total-shift)%total;
+    for(int i=low; i<high; i++) {
         for(int j=0; j<size; j++) {
-            /* In the linear form of the matrix, (i*size+j)-k gives the index of the element in original matrix, - */
-            /* which is mapped to (i, j)-> we add size*size so as to make the operand positive for modulo operator */
-            int rowNumber= ( ( (size*size) + (i*size+j) - k ) % (size*size) ) / size;
-            int columnNumber= ( ( (size*size) + (i*size+j) - k ) % (size*size) ) % size;
-
-            /* T1 and T2 are the shift-accounted elements of first and second matrices */
-            int T1= grid[rowNumber][columnNumber];
-            int T2= second.grid[rowNumber][columnNumber];
-
-            /* Getting sum */
-            int sum= T1+T2;
-            cout<<sum<<" ";
+            out<<sum[source]<<" ";
+            if(++source==total)
+                source=0;
         }
-        cout<<endl;
+        out<<endl;
     }
 }
 
 /* Here, second is the other matrix in the operation and x is the number of the matrix to be transformed */
-void Matrix::MADD(Matrix& second, int x) {
+void Matrix::MADD(Matrix& second, int x, ostream& out) {
+    MADDRows(second, x, 0, size, out);
+}
 
-    /* Summing the matrices */
-    for(int i=0; i<size; i++) {
-        for(int j=0; j<size; j++) {
-            /* Here, the (i, j)th element of the tranformed matrix is simply the (j, i)th element of original */
-            int sum;
-            if(x==1) {
-                sum=grid[j][i]+second.grid[i][j];
+/* Prints rows [low, high) of the sum */
+void Matrix::MADDRows(Matrix& second, int x, int low, int high, ostream& out) {
+    /* The (i, j)th element of the tranformed matrix is simply the (j, i)th element of original */
+    Matrix& straight= x==1 ? second : *this;
+    Matrix& transposed= x==1 ? *this : second;
+
+    /* We build TILE rows of the sum at a time: the straight matrix is copied row by row, and the transposed one */
+    /* is transposed back one TILExTILE block at a time, so that both sides of every block stay in cache */
+    int* band=new int[(size_t)TILE*size];
+    int* block=new int[TILE*TILE];
+    for(int bandLow=low; bandLow<high; bandLow+=TILE) {
+        int bandHigh=min(bandLow+TILE, high);
+
+        for(int i=bandLow; i<bandHigh; i++)
+            copy(straight.row(i), straight.row(i)+size, band+(size_t)(i-bandLow)*size);
+
+        for(int tile=0; tile<size; tile+=TILE) {
+            int width=min(tile+TILE, size)-tile;
+            for(int j=tile; j<tile+width; j++) {
+                int* column=transposed.row(j);
+                for(int i=bandLow; i<bandHigh; i++)
+                    block[(i-bandLow)*TILE+j-tile]=column[i];
+            }
+
+            /* Now every row of the block lines up with a row of the band */
+            for(int i=bandLow; i<bandHigh; i++)
+                kernels.addRow(band+(size_t)(i-bandLow)*size+tile, block+(i-bandLow)*TILE, width);
+        }
+
+        /* Printing the finished rows */
+        for(int i=bandLow; i<bandHigh; i++) {
+            for(int j=0; j<size; j++)
+                out<<band[(size_t)(i-bandLow)*size+j]<<" ";
+            out<<endl;
+        }
+    }
+    delete[] band;
+    delete[] block;
+}
+
+/*============================================================================
+ *  Class:      ThreadPool
+ *  Purpose:    Keep a fixed set of worker threads around, and run
+ *              task(0), ..., task(count-1) on them (and on the caller)
+ * ==========================================================================*/
+class ThreadPool {
+    public:
+        /* The calling thread also does work, so threadCount-1 workers are started */
+        ThreadPool(int threadCount) {
+            for(int i=1; i<threadCount; i++)
+                workers.push_back(thread(&ThreadPool::work, this));
+        }
+
+        /* Runs task on every index in [0, count) and returns once all of them are done */
+        void parallelFor(int count, const function<void(int)>& task) {
+            unique_lock<mutex> lock(m);
+            current=&task;
+            total=count;
+            next=done=0;
+            wake.notify_all();
+
+            /* The caller takes indices like any worker, then waits for the stragglers */
+            while(next<total) {
+                int index=next++;
+                lock.unlock();
+                task(index);
+                lock.lock();
+                done++;
+            }
+            finished.wait(lock, [&]{ return done==total; });
+        }
+
+        /* Stops and joins all workers */
+        ~ThreadPool() {
+            {
+                lock_guard<mutex> lock(m);
+                stopping=true;
+            }
+            wake.notify_all();
+            for(auto& worker: workers)
+                worker.join();
+        }
+
+    private:
+        /* Workers sleep until there are indices left to take */
+        void work() {
+            unique_lock<mutex> lock(m);
+            while(true) {
+                wake.wait(lock, [&]{ return stopping || next<total; });
+                if(stopping) return;
+
+                int index=next++;
+                const function<void(int)>* task=current;
+                lock.unlock();
+                (*task)(index);
+                lock.lock();
+                if(++done==total)
+                    finished.notify_all();
+            }
+        }
+
+        vector<thread> workers;
+        mutex m;
+        condition_variable wake, finished;
+        const function<void(int)>* current=NULL;
+        int total=0, next=0, done=0;
+        bool stopping=false;
+};
+
+/*============================================================================
+ *  Class:      QueryExecutor
+ *  Purpose:    Answer a whole query stream on a thread pool; every query
+ *              is split into row ranges, and results are printed in
+ *              the original order
+ * ==========================================================================*/
+class QueryExecutor {
+    public:
+        QueryExecutor(Matrix& a, Matrix& b, int threads): first(a), second(b), threadCount(threads), pool(threads) {}
+
+        /* Each query is a command and its argument (the shift for MRS, the matrix number for MADD) */
+        void run(const vector<pair<string, int> >& queries, ostream& out);
+
+    private:
+        /* Results of the row ranges of one query; a query already answered before (or earlier in */
+        /* the same window, given by sameAs) has no pieces and just repeats that answer. Pieces [0, scheduled) */
+        /* have been handed out, and pieces [0, printed) printed; a query can go on over several windows. */
+        /* The whole answer is only put together (in joined, then result) if it could be kept */
+        struct Job {
+            int query, pieces, rowsPerPiece, sameAs, scheduled=0, printed=0;
+            bool keep;
+            string joined;
+            shared_ptr<const string> result;
+            vector<string> text;
+            vector<vector<int> > sums;
+            vector<long long> products;
+        };
+
+        /* Splits rows [0, n) into pieces of whole tiles, a few per thread */
+        int rowsPerPiece(int n) {
+            int rows=(n+4*threadCount-1)/(4*threadCount);
+            return max(1, (rows+Matrix::TILE-1)/Matrix::TILE)*Matrix::TILE;
+        }
+
+        /* Pieces of MRS and MADD are made small enough that a window holds a few per thread */
+        int printedRowsPerPiece(int n) {
+            int rows=BUFFERED_ELEMENTS/(4*(size_t)threadCount*max(n, 1));
+            return min(rowsPerPiece(n), max(1, rows/Matrix::TILE)*Matrix::TILE);
+        }
+
+        /* Upper bound on the number of printed elements that are buffered at once (beyond a single piece) */
+        static const size_t BUFFERED_ELEMENTS=1<<22;
+
+        Matrix& first;
+        Matrix& second;
+        int threadCount;
+        ThreadPool pool;
+};
+
+void QueryExecutor::run(const vector<pair<string, int> >& queries, ostream& out) {
+    int n=first.dimension(), Q=queries.size();
+
+    /* Every MRS query prints a shift of the same sum, so the sum is formed once, if needed at all */
+    int* sum=NULL;
+    for(int i=0; i<Q && sum==NULL; i++)
+        if(queries[i].first.compare("MRS")==0)
+            sum=new int[(size_t)n*n];
+    int chunk=rowsPerPiece(n), chunks=(n+chunk-1)/chunk;
+    if(sum!=NULL)
+        pool.parallelFor(chunks, [&](int p) {
+            first.linearSumRows(second, sum, p*chunk, min(n, (p+1)*chunk));
+        });
+
+    /* Queries are answered a window of pieces at a time, so that only a bounded amount of output is held in memory */
+    /* The last query of a window may have pieces left, and is then the first one of the next window */
+    vector<Job> jobs;
+    for(int nextQuery=0; nextQuery<Q || !jobs.empty(); ) {
+        vector<pair<int, int> > pieces;
+        size_t buffered=0;
+        map<pair<string, int>, int> seen;
+        for(size_t j=0; j<jobs.size(); j++)
+            if(jobs[j].sameAs==-1 && jobs[j].pieces>0 && jobs[j].keep)
+                seen[queries[jobs[j].query]]=j;
+
+        while(pieces.empty() || buffered<BUFFERED_ELEMENTS) {
+            if(jobs.empty() || jobs.back().scheduled==jobs.back().pieces) {
+                if(nextQuery==Q)
+                    break;
+                const string& command=queries[nextQuery].first;
+                int argument=queries[nextQuery].second;
+                bool known= command.compare("SPSUM")==0 || command.compare("MOD")==0 || command.compare("MRS")==0 || command.compare("MADD")==0;
+                bool printed= command.compare("MRS")==0 || command.compare("MADD")==0;
+                Job job;
+                job.query=nextQuery++;
+                job.rowsPerPiece= printed ? printedRowsPerPiece(n) : chunk;
+                job.sameAs=-1;
+                job.pieces= known ? (n+job.rowsPerPiece-1)/job.rowsPerPiece : 1;
+
+                /* A printed element takes at most 11 characters and a separator */
+                job.keep= known && (!printed || Matrix::fitsCache((size_t)n*n*12));
+
+                /* Queries with a kept answer need no work */
+                if(known && seen.count(make_pair(command, argument))) {
+                    job.sameAs=seen[make_pair(command, argument)];
+                    job.pieces=0;
+                    first.countRepeat();
+                } else if(known && (job.result=first.lookup(command, argument, &second))) {
+                    job.pieces=0;
+                } else if(job.keep) {
+                    seen[make_pair(command, argument)]=jobs.size();
+                }
+
+                job.text.resize(job.pieces);
+                if(command.compare("SPSUM")==0)
+                    job.sums.assign(job.pieces, vector<int>(n));
+                if(command.compare("MOD")==0)
+                    job.products.resize(job.pieces);
+                jobs.push_back(job);
+                continue;
+            }
+
+            /* Hand out the next piece of the last query */
+            Job& job=jobs.back();
+            const string& command=queries[job.query].first;
+            int rows=min(n-job.scheduled*job.rowsPerPiece, job.rowsPerPiece);
+            buffered+= command.compare("MRS")==0 || command.compare("MADD")==0 ? (size_t)rows*n : command.compare("SPSUM")==0 ? n : 1;
+            pieces.push_back(make_pair(jobs.size()-1, job.scheduled++));
+        }
+
+        /* All pieces of the window run in parallel */
+        pool.parallelFor(pieces.size(), [&](int index) {
+            Job& job=jobs[pieces[index].first];
+            int p=pieces[index].second, low=p*job.rowsPerPiece, high=min(n, low+job.rowsPerPiece);
+            const string& command=queries[job.query].first;
+            int argument=queries[job.query].second;
+
+            if(command.compare("SPSUM")==0) {
+                first.SPSUMRows(low, high, job.sums[p].data());
+            } else if(command.compare("MOD")==0) {
+                job.products[p]=first.MODRows(low, high);
+            } else if(command.compare("MRS")==0) {
+                ostringstream text;
+                first.MRSRows(sum, argument, low, high, text);
+                job.text[p]=text.str();
+            } else if(command.compare("MADD")==0) {
+                ostringstream text;
+                first.MADDRows(second, argument, low, high, text);
+                job.text[p]=text.str();
             } else {
-                sum=grid[i][j]+second.grid[j][i];
+                job.text[p]="INVALID COMMAND\n";
+            }
+        });
+
+        /* Printed pieces go out as soon as the ones before them have; the rest of the results are combined, kept */
+        /* and printed in query order once all their pieces are done */
+        for(Job& job: jobs) {
+            const string& command=queries[job.query].first;
+            int argument=queries[job.query].second;
+            if(job.sameAs!=-1) {
+                out<<*jobs[job.sameAs].result<<flush;
+                continue;
+            }
+            if(job.pieces==0) {
+                out<<*job.result<<flush;
+                continue;
+            }
+
+            bool printed= command.compare("SPSUM")!=0 && command.compare("MOD")!=0;
+            if(printed) {
+                for(; job.printed<job.scheduled; job.printed++) {
+                    out<<job.text[job.printed]<<flush;
+                    if(job.keep)
+                        job.joined+=job.text[job.printed];
+                    string().swap(job.text[job.printed]);
+                }
             }
-            cout<<sum<<" ";
+            if(job.scheduled<job.pieces)
+                continue;
+
+            if(command.compare("SPSUM")==0) {
+                ostringstream text;
+                for(int p=1; p<job.pieces; p++)
+                    Kernels::best().addRow(job.sums[0].data(), job.sums[p].data(), n);
+                first.printSPSUM(job.sums[0].data(), text);
+                job.joined=text.str();
+            } else if(command.compare("MOD")==0) {
+                ostringstream text;
+                unsigned long long product=1;
+                for(int p=0; p<job.pieces; p++)
+                    product*=job.products[p];
+                text<<(long long)product<<endl;
+                job.joined=text.str();
+            }
+            if(!job.keep)
+                continue;
+            job.result=make_shared<const string>(move(job.joined));
+            if(seen.count(make_pair(command, argument)))
+                first.remember(command, argument, &second, job.result);
+            if(!printed)
+                out<<*job.result<<flush;
+        }
+
+        /* Only a query with pieces left stays */
+        if(!jobs.empty() && jobs.back().scheduled<jobs.back().pieces) {
+            Job last=move(jobs.back());
+            jobs.clear();
+            jobs.push_back(move(last));
+        } else {
+            jobs.clear();
         }
-        cout<<endl;
     }
+    delete[] sum;
 }
 
-int main() {
+int main(int argc, char** argv) {
+    /* The number of threads can be given as --threads T (or --threads=T), and defaults to the number of cores */
+    /* With --stats, the result cache hit and miss counts are printed to cerr at the end */
+    /* With --check, the vector kernels are compared with the scalar ones on both matrices, differences are reported on */
+    /* cerr, and the queries are still answered, but the exit status is 1 */
+    int threads=thread::hardware_concurrency();
+    bool stats=false, check=false;
+    for(int i=1; i<argc; i++) {
+        if(strcmp(argv[i], "--threads")==0 && i+1<argc)
+            threads=atoi(argv[++i]);
+        else if(strncmp(argv[i], "--threads=", 10)==0)
+            threads=atoi(argv[i]+10);
+        else if(strcmp(argv[i], "--stats")==0)
+            stats=true;
+        else if(strcmp(argv[i], "--check")==0)
+            check=true;
+    }
+    threads=max(threads, 1);
+
     /* Taking inputs */
     int Q, n;
     cin>>Q>>n;
 
     /* Allocating memory for the matrices */
-    int** A=new int*[n];
-    for(int i=0; i<n; i++)
-        A[i]=new int[n];
-    
-    int** B=new int*[n];
-    for(int i=0; i<n; i++)
-        B[i]=new int[n];
+    int* A=Matrix::allocateGrid(n);
+    int* B=Matrix::allocateGrid(n);
+    int stride=Matrix::paddedStride(n);
 
     /* Reading in the matrices */
     for(int i=0; i<n; i++)
         for(int j=0; j<n; j++)
-            cin>>A[i][j];
+            cin>>A[(size_t)i*stride+j];
 
     for(int i=0; i<n; i++)
         for(int j=0; j<n; j++)
-            cin>>B[i][j];
+            cin>>B[(size_t)i*stride+j];
+
+    /* Both checks run, so that every differing row is reported */
+    bool kernelsAgree= !check || (Kernels::check(A, B, n, stride) & Kernels::check(B, A, n, stride));
 
-    /* Creating Matrix objects */
+    /* Creating Matrix objects; SPSUM and MOD only depend on the first matrix, so they are worked out while the queries are read */
     Matrix first(n, A), second(n, B);
+    first.precompute();
 
-    /* Performing operations indicated by queries */
+    /* Reading in all the queries first; they only read the matrices, so they can all be answered in parallel */
+    vector<pair<string, int> > queries(Q);
     for(int i=0; i<Q; i++) {
-        string input;
-        cin>>input;
-        if(input.compare("SPSUM")==0) {
-            first.SPSUM();
-        } else if(input.compare("MOD")==0) {
-            first.MOD();
-        } else if(input.compare("MRS")==0) {
-            int k;
-            cin>>k;
-            first.MRS(second, k);
-        } else if(input.compare("MADD")==0) {
-            int x;
-            cin>>x;
-            first.MADD(second, x);
-        } else {
-            cout<<"INVALID COMMAND"<<endl;
-        }
+        cin>>queries[i].first;
+        if(queries[i].first.compare("MRS")==0 || queries[i].first.compare("MADD")==0)
+            cin>>queries[i].second;
     }
-    
+
+    /* Performing operations indicated by queries */
+    QueryExecutor executor(first, second, threads);
+    executor.run(queries, cout);
+
+    if(stats)
+        cerr<<"cache hits: "<<first.cacheHits()<<", misses: "<<first.cacheMisses()<<endl;
+    return kernelsAgree ? 0 : 1;
 }
@@ -1,5 +1,14 @@
 #include<iostream>
 #include<algorithm>
+#include<vector>
+#include<climits>
+#include<new>
+#include<thread>
+#include<cstring>
+#include<cstdlib>
+#ifdef __SSE2__
+#include<emmintrin.h>
+#endif
 using namespace std;
 
 /* This structure is used when we need to pair two associated integer values */
@@ -13,15 +22,39 @@ class Matrix {
     /* These functions are accessible from any function, including main */
     public:
         Matrix(int n, int m, int** A): rowCount(n), columnCount(m), grid(A) {}
+
+        /* The grid belongs to the caller, but the search layout belongs to the matrix, so copies are not allowed */
+        virtual ~Matrix() { dropSearchLayout(); }
+        Matrix(const Matrix&)=delete;
+        Matrix& operator=(const Matrix&)=delete;
         int binarySearch(int, int);
         point matrixSearch(int);
+        vector<point> matrixSearch(const vector<int>&);
+
+        /* Optional: lays every row out again as a static B-tree, which binarySearch uses from then on (an older layout is dropped) */
+        void buildSearchLayout();
 
     /* The matrix dimensions can be accessed by the derived class */
     protected:
         int rowCount, columnCount;
 
+        /* Derived classes that change the grid must refresh the layout of a changed row, or drop the layout altogether */
+        void refreshSearchLayout(int row);
+        void dropSearchLayout();
+
     /* The matrix elements themselves are private and can't be accesses from derived class */
         int** grid;
+
+    /* In the B-tree layout every node is NODE keys filling one cache line, and node k has children k*(NODE+1)+1 ... k*(NODE+1)+NODE+1 */
+    private:
+        static const int NODE=16;
+        int nodeRank(const int* node, int x);
+        void buildTreeColumns(int node, int& next);
+
+        /* tree holds nodeCount nodes per row; treeColumn maps a slot of any row to its column (columnCount for padding) */
+        int* tree=NULL;
+        int* treeColumn=NULL;
+        int nodeCount=0;
 };
 
 /* Derived class: Add to the functionality of parent class */
@@ -30,14 +63,287 @@ class MatrixMedian : public Matrix {
     public:
         MatrixMedian(int n, int m, int** A): Matrix(n, m, A) {}
         int findMedian();
+        int select(long long k);
+
+        /* Number of threads that count ranks in select (1 by default) */
+        void setThreads(int threads) { threadCount=max(threads, 1); }
 
-    /* This function is only for internal use in findMedian */
+    /* These functions are only for internal use in select */
     private:
-        int upperBound(int, int);
+        static int weightedMedian(vector<pair<int, int> >& middles, long long totalWeight);
+        void countRanks(int pivot, const vector<int>& low, const vector<int>& high, vector<int>& lessEnd, vector<int>& notGreaterEnd, long long& lessThan, long long& lessThanOrEqualTo);
+
+        /* Below this many rows per thread, starting threads costs more than the counting itself */
+        static const int ROWS_PER_THREAD=4096;
+        int threadCount=1;
 };
 
+/* Multiset of integers, kept as a treap of distinct values with their multiplicities */
+/* Counting the elements less than a value, and finding the element of a given rank, take O(log n) expected time */
+class OrderStatistics {
+    public:
+        /* Adds times copies of x, or removes one copy of x */
+        void insert(int x, long long times=1) { root=insert(root, x, times); }
+        void erase(int x) { root=erase(root, x); }
+
+        /* Returns the number of elements less than x */
+        long long countLess(int x);
+
+        /* Returns the element of rank k (counting from 0) */
+        int kth(long long k);
+
+        long long size() { return total(root); }
+
+        ~OrderStatistics() { destroy(root); }
+
+    private:
+        /* Every node keeps the number of elements in its subtree; priorities keep the tree balanced with high probability */
+        struct node {
+            int value;
+            long long count, subtree;
+            unsigned priority;
+            node *left, *right;
+            node(int x, long long c, unsigned p): value(x), count(c), subtree(c), priority(p), left(NULL), right(NULL) {}
+        };
+
+        static long long total(node* t) { return t==NULL ? 0 : t->subtree; }
+        static void update(node* t) { t->subtree=t->count+total(t->left)+total(t->right); }
+        static node* rotateRight(node* t);
+        static node* rotateLeft(node* t);
+        node* insert(node* t, int x, long long times);
+        node* erase(node* t, int x);
+        void destroy(node* t);
+
+        /* xorshift generator for priorities */
+        unsigned nextPriority() {
+            seed^=seed<<13;
+            seed^=seed>>17;
+            seed^=seed<<5;
+            return seed;
+        }
+
+        node* root=NULL;
+        unsigned seed=2463534242u;
+};
+
+OrderStatistics::node* OrderStatistics::rotateRight(node* t) {
+    node* l=t->left;
+    t->left=l->right;
+    l->right=t;
+    update(t);
+    update(l);
+    return l;
+}
+
+OrderStatistics::node* OrderStatistics::rotateLeft(node* t) {
+    node* r=t->right;
+    t->right=r->left;
+    r->left=t;
+    update(t);
+    update(r);
+    return r;
+}
+
+OrderStatistics::node* OrderStatistics::insert(node* t, int x, long long times) {
+    if(t==NULL)
+        return new node(x, times, nextPriority());
+    if(x==t->value) {
+        t->count+=times;
+    } else if(x<t->value) {
+        t->left=insert(t->left, x, times);
+        if(t->left->priority>t->priority)
+            t=rotateRight(t);
+    } else {
+        t->right=insert(t->right, x, times);
+        if(t->right->priority>t->priority)
+            t=rotateLeft(t);
+    }
+    update(t);
+    return t;
+}
+
+OrderStatistics::node* OrderStatistics::erase(node* t, int x) {
+    if(t==NULL)
+        return NULL;
+    if(x<t->value) {
+        t->left=erase(t->left, x);
+    } else if(x>t->value) {
+        t->right=erase(t->right, x);
+    } else if(t->count>1) {
+        t->count--;
+    } else if(t->left==NULL || t->right==NULL) {
+        /* A node with at most one child can be replaced by that child */
+        node* child= t->left!=NULL ? t->left : t->right;
+        delete t;
+        return child;
+    } else if(t->left->priority>t->right->priority) {
+        /* Otherwise we rotate the node down towards the leaves until it has at most one child */
+        t=rotateRight(t);
+        t->right=erase(t->right, x);
+    } else {
+        t=rotateLeft(t);
+        t->left=erase(t->left, x);
+    }
+    update(t);
+    return t;
+}
+
+void OrderStatistics::destroy(node* t) {
+    if(t==NULL)
+        return;
+    destroy(t->left);
+    destroy(t->right);
+    delete t;
+}
+
+long long OrderStatistics::countLess(int x) {
+    long long less=0;
+    for(node* t=root; t!=NULL; ) {
+        if(x<=t->value) {
+            t=t->left;
+        } else {
+            less+=total(t->left)+t->count;
+            t=t->right;
+        }
+    }
+    return less;
+}
+
+int OrderStatistics::kth(long long k) {
+    for(node* t=root; t!=NULL; ) {
+        if(k<total(t->left)) {
+            t=t->left;
+        } else if(k<total(t->left)+t->count) {
+            return t->value;
+        } else {
+            k-=total(t->left)+t->count;
+            t=t->right;
+        }
+    }
+    return -1;
+}
+
+/* Derived class: MatrixMedian that also allows appending sorted rows and changing single values */
+/* Until the first change, queries go to MatrixMedian; from then on, a multiset of all the elements answers them in O(log N) */
+class DynamicMatrixMedian : public MatrixMedian {
+    public:
+        DynamicMatrixMedian(int n, int m, int** A): MatrixMedian(n, m, A), rows(A, A+n), givenRows(n) {}
+
+        /* Frees the rows added by appendRow; the rows of A belong to the caller */
+        ~DynamicMatrixMedian() {
+            for(size_t i=givenRows; i<rows.size(); i++)
+                delete[] rows[i];
+        }
+
+        /* Appends a copy of a sorted row of columnCount elements */
+        void appendRow(const int* row);
+
+        /* Replaces the element at (row, column) by value, moving it so that the row stays sorted */
+        void update(int row, int column, int value);
+
+        /* Same results as in MatrixMedian */
+        int findMedian();
+        int select(long long k);
+
+        /* Returns the number of elements less than x */
+        long long rank(int x);
+
+    private:
+        /* Puts every element into the multiset, the first time it is needed */
+        void buildCounts();
+
+        vector<int*> rows;
+        size_t givenRows;
+        OrderStatistics counts;
+        bool built=false;
+};
+
+void DynamicMatrixMedian::buildCounts() {
+    if(built)
+        return;
+    built=true;
+
+    /* Equal values are counted together, so the multiset gets one insertion per distinct value */
+    vector<int> values;
+    values.reserve((size_t)rowCount*columnCount);
+    for(int i=0; i<rowCount; i++)
+        values.insert(values.end(), grid[i], grid[i]+columnCount);
+    sort(values.begin(), values.end());
+    for(size_t i=0, j; i<values.size(); i=j) {
+        for(j=i; j<values.size() && values[j]==values[i]; j++)
+            ;
+        counts.insert(values[i], j-i);
+    }
+}
+
+void DynamicMatrixMedian::appendRow(const int* row) {
+    buildCounts();
+
+    int* copied=new int[columnCount];
+    for(int j=0; j<columnCount; j++) {
+        copied[j]=row[j];
+        counts.insert(row[j]);
+    }
+    rows.push_back(copied);
+    grid=rows.data();
+    rowCount++;
+
+    /* The B-tree layout has room for the old rows only */
+    dropSearchLayout();
+}
+
+void DynamicMatrixMedian::update(int row, int column, int value) {
+    buildCounts();
+    counts.erase(grid[row][column]);
+    counts.insert(value);
+
+    /* The new value slides left or right until the row is sorted again */
+    int* r=grid[row];
+    int j=column;
+    for(; j>0 && r[j-1]>value; j--)
+        r[j]=r[j-1];
+    for(; j+1<columnCount && r[j+1]<value; j++)
+        r[j]=r[j+1];
+    r[j]=value;
+    refreshSearchLayout(row);
+}
+
+int DynamicMatrixMedian::findMedian() {
+    return select(((long long)rowCount*columnCount)/2);
+}
+
+int DynamicMatrixMedian::select(long long k) {
+    if(!built)
+        return MatrixMedian::select(k);
+    if(k<0 || k>=counts.size())
+        return -1;
+    return counts.kth(k);
+}
+
+long long DynamicMatrixMedian::rank(int x) {
+    if(built)
+        return counts.countLess(x);
+    long long less=0;
+    for(int i=0; i<rowCount; i++)
+        less+=lower_bound(grid[i], grid[i]+columnCount, x)-grid[i];
+    return less;
+}
+
 /* Returns column index of last element in row less than or equal to x */
 int Matrix::binarySearch(int x, int k) {
+    /* With the B-tree layout, we walk down one cache line per level and remember the last slot holding something greater than x */
+    if(tree!=NULL) {
+        int* rowTree=tree+(size_t)k*nodeCount*NODE;
+        int firstGreater=columnCount;
+        for(int node=0; node<nodeCount; ) {
+            int rank=nodeRank(rowTree+node*NODE, x);
+            if(rank<NODE)
+                firstGreater=treeColumn[node*NODE+rank];
+            node=node*(NODE+1)+rank+1;
+        }
+        return firstGreater-1;
+    }
+
     /* We are searching in the range [0, columnCount) */
     int left=0, right=columnCount;
 
@@ -51,6 +357,65 @@ int Matrix::binarySearch(int x, int k) {
     return grid[k][left]<=x ? left : -1;
 }
 
+/* Returns the number of keys in the node which are less than or equal to x */
+int Matrix::nodeRank(const int* node, int x) {
+#ifdef __SSE2__
+    /* Keys in a node are sorted, so the keys greater than x are exactly the set bits of the comparison mask */
+    __m128i key=_mm_set1_epi32(x);
+    int greater=0;
+    for(int i=0; i<NODE; i+=4) {
+        __m128i compared=_mm_cmpgt_epi32(_mm_load_si128((const __m128i*)(node+i)), key);
+        greater|=_mm_movemask_ps(_mm_castsi128_ps(compared))<<i;
+    }
+    return NODE-__builtin_popcount(greater);
+#else
+    int rank=0;
+    for(int i=0; i<NODE; i++)
+        rank+= node[i]<=x;
+    return rank;
+#endif
+}
+
+/* Fills treeColumn by visiting the B-tree in order, so that slots get columns 0, 1, 2, ... in sorted order */
+void Matrix::buildTreeColumns(int node, int& next) {
+    if(node>=nodeCount)
+        return;
+    for(int i=0; i<NODE; i++) {
+        buildTreeColumns(node*(NODE+1)+i+1, next);
+        treeColumn[node*NODE+i]= next<columnCount ? next++ : columnCount;
+    }
+    buildTreeColumns(node*(NODE+1)+NODE+1, next);
+}
+
+void Matrix::buildSearchLayout() {
+    dropSearchLayout();
+
+    /* The slot to column map only depends on the row length, so it is shared by all rows */
+    nodeCount=(columnCount+NODE-1)/NODE;
+    treeColumn=new int[(size_t)nodeCount*NODE];
+    int next=0;
+    buildTreeColumns(0, next);
+
+    tree=new(align_val_t(64)) int[(size_t)rowCount*nodeCount*NODE];
+    for(int i=0; i<rowCount; i++)
+        refreshSearchLayout(i);
+}
+
+void Matrix::refreshSearchLayout(int row) {
+    if(tree==NULL)
+        return;
+
+    /* Padding slots hold INT_MAX; they sort after every real key, so they are only ever reported as column columnCount */
+    for(int slot=0; slot<nodeCount*NODE; slot++)
+        tree[(size_t)row*nodeCount*NODE+slot]= treeColumn[slot]<columnCount ? grid[row][treeColumn[slot]] : INT_MAX;
+}
+
+void Matrix::dropSearchLayout() {
+    operator delete[](tree, align_val_t(64));
+    delete[] treeColumn;
+    tree=treeColumn=NULL;
+}
+
 /* Returns location of 'first' element in matrix equal to x */
 point Matrix::matrixSearch(int x) {
     /* temp stores the result of the call to binarySearch */
@@ -65,45 +430,167 @@ point Matrix::matrixSearch(int x) {
     return point(-1, -1);
 }
 
-/* Returns column index of first element in row greater than x */
-int MatrixMedian::upperBound(int x, int k) {
-    /* binarySearch(x, k) gives the last column of an element less than or equal to x */
-    /* Therefore the next column should be the first column of an element greater than x */
-    int temp= binarySearch(x, k);
-    return temp+1!=columnCount ? temp+1 : -1;
+/* Answers a whole batch of matrixSearch queries at once, in the order given */
+vector<point> Matrix::matrixSearch(const vector<int>& queries) {
+    vector<point> answers(queries.size(), point(-1, -1));
+
+    /* The distinct query values in ascending order; pending holds the ones not yet found in any row */
+    vector<int> pending(queries);
+    sort(pending.begin(), pending.end());
+    pending.erase(unique(pending.begin(), pending.end()), pending.end());
+
+    /* found[v] is where the first occurrence of pending value v was found */
+    vector<int> values(pending);
+    vector<point> found(values.size(), point(-1, -1));
+
+    /* Rows are visited in order, so the first row a value shows up in is the one we want */
+    for(int i=0; i<rowCount && !pending.empty(); i++) {
+        /* The row and the pending values are both sorted, so one forward sweep matches them up; */
+        /* when there are few pending values, jumping ahead with a binary search is cheaper than stepping */
+        bool sweep= pending.size()*8>=(size_t)columnCount;
+        int column=0, kept=0;
+        for(int x: pending) {
+            if(sweep) {
+                while(column<columnCount && grid[i][column]<x)
+                    column++;
+            } else {
+                column=lower_bound(grid[i]+column, grid[i]+columnCount, x)-grid[i];
+            }
+
+            if(column<columnCount && grid[i][column]==x)
+                found[lower_bound(values.begin(), values.end(), x)-values.begin()]=point(i, column);
+            else
+                pending[kept++]=x;
+        }
+        pending.resize(kept);
+    }
+
+    for(size_t q=0; q<queries.size(); q++)
+        answers[q]=found[lower_bound(values.begin(), values.end(), queries[q])-values.begin()];
+    return answers;
 }
 
 /* Returns median of entire matrix */
-int MatrixMedian::findMedian() {    
-    int halfCount= (rowCount*columnCount)/2;
-
-    /*Essentially, we will perform binary search over the entire range of the median */
-    int left=-2147483648, right=2147483647;
-    for(int middle=(left+right)/2; left<=right; middle=(left+right)/2) {
-        /* An element is median if : */
-        /* 1) The number of elements less than it (in all rows) is not greater than (N-1)/2 */
-        /* 2) The number of elements less than or equal to it is greater than or equal to  (N+1)/2 */
-        /* Using previously written upperBound function, we can quickly find both of the above counts across all rows */
-        int lessThanOrEqualTo=0, lessThan=0;
-        for(int i=0; i<rowCount; i++) {
-            int temp1=upperBound(middle, i), temp2=upperBound(middle-1, i);
-            lessThanOrEqualTo += temp1!=-1 ? temp1 : columnCount;
-            lessThan += temp2!=-1 ? temp2 : columnCount;
+int MatrixMedian::findMedian() {
+    /* The median is the element with exactly (N-1)/2 or N/2 elements before it- we take the element of rank N/2 */
+    return select(((long long)rowCount*columnCount)/2);
+}
+
+/* Returns the element of rank k (counting from 0) in the sorted order of all the matrix elements, or -1 if there is none */
+/* Works on positions rather than values, so the cost depends only on the shape: O(rowCount*log(columnCount)*log(N)) */
+int MatrixMedian::select(long long k) {
+    if(k<0 || k>=(long long)rowCount*columnCount)
+        return -1;
+
+    /* Only the elements in columns [low[i], high[i]) of row i are still candidates; k is the rank among the candidates */
+    vector<int> low(rowCount, 0), high(rowCount, columnCount);
+    long long remaining=(long long)rowCount*columnCount;
+
+    while(remaining>max(rowCount, 32)) {
+        /* The middle candidate of every row, weighted by the number of candidates in that row */
+        vector<pair<int, int> > middles;
+        for(int i=0; i<rowCount; i++)
+            if(low[i]<high[i])
+                middles.push_back(make_pair(grid[i][low[i]+(high[i]-low[i]-1)/2], high[i]-low[i]));
+
+        /* The pivot is the weighted median of the middles: at least a quarter of the candidates are <= pivot and at least a quarter are >= pivot */
+        int pivot=weightedMedian(middles, remaining);
+
+        /* Count candidates less than and not greater than the pivot */
+        vector<int> lessEnd(rowCount), notGreaterEnd(rowCount);
+        long long lessThan, lessThanOrEqualTo;
+        countRanks(pivot, low, high, lessEnd, notGreaterEnd, lessThan, lessThanOrEqualTo);
+
+        /* Either the pivot is the answer, or we can throw away every candidate on the wrong side of it */
+        if(k<lessThan) {
+            high=lessEnd;
+            remaining=lessThan;
+        } else if(k<lessThanOrEqualTo) {
+            return pivot;
+        } else {
+            low=notGreaterEnd;
+            k-=lessThanOrEqualTo;
+            remaining-=lessThanOrEqualTo;
         }
+    }
 
-        /* If the condition doesn't hold, and the number of elements less than the element is greater than (N-1)/2, median is less than given candidate */
-        /* Similarly if condition doesn't hold, and number of elements not greater than median candidate is less than or equal to (N-1)/2, median is greater than given candidate */
-        if(lessThan<=halfCount && lessThanOrEqualTo>halfCount)
-            return middle;
-        else if(lessThan>halfCount)
-            right=middle-1;
-        else
+    /* Few enough candidates are left to just gather them and select directly */
+    vector<int> candidates;
+    for(int i=0; i<rowCount; i++)
+        candidates.insert(candidates.end(), grid[i]+low[i], grid[i]+high[i]);
+    nth_element(candidates.begin(), candidates.begin()+k, candidates.end());
+    return candidates[k];
+}
+
+/* Returns the smallest value whose weight, together with the weight of all smaller values, is at least half of totalWeight */
+/* Uses quickselect on the (value, weight) pairs, so it takes expected linear time; the pairs are reordered */
+int MatrixMedian::weightedMedian(vector<pair<int, int> >& middles, long long totalWeight) {
+    long long needed=(totalWeight+1)/2;
+    size_t left=0, right=middles.size();
+    while(true) {
+        size_t middle=left+(right-left)/2;
+        nth_element(middles.begin()+left, middles.begin()+middle, middles.begin()+right);
+
+        /* Everything in [left, middle) is now no greater than middles[middle] */
+        long long weight=0;
+        for(size_t i=left; i<middle; i++)
+            weight+=middles[i].second;
+
+        if(weight>=needed) {
+            right=middle;
+        } else if(weight+middles[middle].second>=needed) {
+            return middles[middle].first;
+        } else {
+            needed-=weight+middles[middle].second;
             left=middle+1;
+        }
     }
-    return -1;
 }
 
-int main() {
+/* For every row, finds where the candidates less than pivot, and not greater than pivot, end, and totals both counts */
+/* Rows are split into one contiguous block per thread; each thread sums its own block and the block totals are added up at the end */
+void MatrixMedian::countRanks(int pivot, const vector<int>& low, const vector<int>& high, vector<int>& lessEnd, vector<int>& notGreaterEnd, long long& lessThan, long long& lessThanOrEqualTo) {
+    int threads=max(1, min(threadCount, rowCount/ROWS_PER_THREAD));
+    vector<long long> partialLess(threads), partialNotGreater(threads);
+
+    auto countBlock=[&](int t) {
+        int first=(long long)rowCount*t/threads, last=(long long)rowCount*(t+1)/threads;
+        long long less=0, notGreater=0;
+        for(int i=first; i<last; i++) {
+            lessEnd[i]=lower_bound(grid[i]+low[i], grid[i]+high[i], pivot)-grid[i];
+            notGreaterEnd[i]=upper_bound(grid[i]+lessEnd[i], grid[i]+high[i], pivot)-grid[i];
+            less+=lessEnd[i]-low[i];
+            notGreater+=notGreaterEnd[i]-low[i];
+        }
+        partialLess[t]=less;
+        partialNotGreater[t]=notGreater;
+    };
+
+    /* The calling thread takes the first block itself */
+    vector<thread> workers;
+    for(int t=1; t<threads; t++)
+        workers.push_back(thread(countBlock, t));
+    countBlock(0);
+    for(auto& worker: workers)
+        worker.join();
+
+    lessThan=lessThanOrEqualTo=0;
+    for(int t=0; t<threads; t++) {
+        lessThan+=partialLess[t];
+        lessThanOrEqualTo+=partialNotGreater[t];
+    }
+}
+
+int main(int argc, char** argv) {
+    /* The number of threads used by findMedian can be given as --threads T (or --threads=T) */
+    int threads=1;
+    for(int i=1; i<argc; i++) {
+        if(strcmp(argv[i], "--threads")==0 && i+1<argc)
+            threads=atoi(argv[++i]);
+        else if(strncmp(argv[i], "--threads=", 10)==0)
+            threads=atoi(argv[i]+10);
+    }
+
     /* Taking inputs */
     int n, m;
     cin>>n>>m;
@@ -118,29 +605,59 @@ int main() {
         for(int j=0; j<m; j++)
             cin>>A[i][j];
 
-    /* Creating MatrixMedian object */
-    MatrixMedian obj(n, m, A);
+    /* Creating MatrixMedian object, with the cache friendly search layout */
+    DynamicMatrixMedian obj(n, m, A);
+    obj.buildSearchLayout();
+    obj.setThreads(threads);
 
     int Q;
     cin>>Q;
 
-    /* Performing operations indicated by queries */
+    /* Reading in all queries first, so that the MS queries can be answered together in batches */
+    /* ADDROW is followed by a sorted row of m elements, and UPDATE r c v sets the element at (r, c) to v */
+    vector<string> commands(Q);
+    vector<vector<int> > arguments(Q);
     for(int i=0; i<Q; i++) {
-        string input;
-        cin>>input;
-        if(input.compare("BS")==0) {
-            int x, k;
-            cin>>x>>k;
-            cout<<obj.binarySearch(x, k)<<endl;
-        } else if(input.compare("MS")==0) {
-            int x;
-            cin>>x;
-            point temp=obj.matrixSearch(x);
-            cout<<temp.first<<" "<<temp.second<<endl;
-        } else {
-            int median= obj.findMedian();
-            cout<<median<<endl;
+        cin>>commands[i];
+        int count= commands[i].compare("BS")==0 ? 2 : commands[i].compare("MS")==0 ? 1 : commands[i].compare("ADDROW")==0 ? m : commands[i].compare("UPDATE")==0 ? 3 : 0;
+        arguments[i].resize(count);
+        for(int j=0; j<count; j++)
+            cin>>arguments[i][j];
+    }
+
+    /* Queries between two changes to the matrix form a segment, and the MS queries of a segment form one batch */
+    for(int low=0; low<Q; ) {
+        int high=low;
+        vector<int> searches;
+        for(; high<Q && commands[high].compare("ADDROW")!=0 && commands[high].compare("UPDATE")!=0; high++)
+            if(commands[high].compare("MS")==0)
+                searches.push_back(arguments[high][0]);
+        vector<point> searchResults=obj.matrixSearch(searches);
+
+        /* Performing operations indicated by queries */
+        for(int i=low, s=0; i<high; i++) {
+            string& input=commands[i];
+            if(input.compare("BS")==0) {
+                cout<<obj.binarySearch(arguments[i][0], arguments[i][1])<<endl;
+            } else if(input.compare("MS")==0) {
+                point temp=searchResults[s++];
+                cout<<temp.first<<" "<<temp.second<<endl;
+            } else {
+                int median= obj.findMedian();
+                cout<<median<<endl;
+            }
         }
+
+        /* Applying the change that ends the segment */
+        if(high<Q && commands[high].compare("ADDROW")==0)
+            obj.appendRow(arguments[high].data());
+        else if(high<Q)
+            obj.update(arguments[high][0], arguments[high][1], arguments[high][2]);
+        low=high+1;
     }
-    
+
+    /* Freeing the given rows; obj frees the rows it added, and its search layout */
+    for(int i=0; i<n; i++)
+        delete[] A[i];
+    delete[] A;
 }
@@ -1,192 +1,677 @@
 #include<iostream>
 #include<stack>
+#include<vector>
+#include<cstdint>
+#include<cstring>
+#include<map>
+#include<unordered_set>
+#include<atomic>
+#include<thread>
+#include<cstdlib>
+#include<random>
 using namespace std;
 
 /* This class provides support for basic stack functionality */
+/* Values are stored in fixed size chunks rather than one node per value; chunks that empty out go to a free list */
+/* shared by all stacks of the thread, so that the many short lived stacks made by the graph traversals reuse memory */
 class Stack {
     public:
         /* Pushes element to top of stack */
         void Push(int x) {
-            node* temp=new node(x, topOfStack);
-            topOfStack=temp;
+            /* Start a new chunk if the top one is full (or there is none) */
+            if(topChunk==NULL || used==CHUNK) {
+                chunk* temp=freeChunks;
+                if(temp!=NULL)
+                    freeChunks=freeChunks->next;
+                else
+                    temp=new chunk;
+                temp->next=topChunk;
+                topChunk=temp;
+                used=0;
+            }
+            topChunk->values[used++]=x;
         }
         /* Removes and returns top element */
         int Pop() {
             /* Return -1 if empty */
-            if(topOfStack==NULL) 
+            if(topChunk==NULL) 
                 return -1;
 
-            /* Remove top element and update topOfStack pointer */
-            node* toDelete=topOfStack;
-            topOfStack=topOfStack->next;
-
-            /* Free memory and return the element */
-            int output=toDelete->value;
-            delete toDelete;
+            /* Remove top element- if that empties the top chunk, hand the chunk back to the free list */
+            int output=topChunk->values[--used];
+            if(used==0) {
+                chunk* toFree=topChunk;
+                topChunk=topChunk->next;
+                toFree->next=freeChunks;
+                freeChunks=toFree;
+                used= topChunk!=NULL ? CHUNK : 0;
+            }
             return output;
         }
         /* Returns top element */
         int Top() {
             /* Return -1 if empty */
-            if(topOfStack==NULL)
+            if(topChunk==NULL)
                 return -1;
 
             /* Return element at top of stack */
-            return topOfStack->value;
+            return topChunk->values[used-1];
         }
         /* Checks if stack is empty */
         bool isEmpty() {
-            return topOfStack==NULL;
+            return topChunk==NULL;
         }
-        /* Deletes all stack elements */
+        /* Hands all chunks back to the free list */
         ~Stack() {
-            while(topOfStack!=NULL) {
-                node* temp=topOfStack;
-                topOfStack=topOfStack->next;
-                delete temp;
+            while(topChunk!=NULL) {
+                chunk* temp=topChunk;
+                topChunk=topChunk->next;
+                temp->next=freeChunks;
+                freeChunks=temp;
             }
         }
     private:
-        /* Internal definition of node used by Stack */
-        struct node {
-            int value;
-            node* next;
-            node(int x, node* p): value(x), next(p) {}
+        /* Internal definition of chunk used by Stack: a block of values, and a pointer to the chunk below */
+        static const int CHUNK=1022;
+        struct chunk {
+            int values[CHUNK];
+            chunk* next;
         };
 
-        /* This variable is a pointer to the top of the stack */
-        node* topOfStack=NULL;
+        /* topChunk is the chunk at the top of the stack, and it holds used values; every chunk below it is full */
+        chunk* topChunk=NULL;
+        int used=0;
+
+        /* Chunks not in use by any stack of this thread */
+        static thread_local chunk* freeChunks;
 };
 
+thread_local Stack::chunk* Stack::freeChunks=NULL;
+
 /* This class maintains common details of a graph and contains procedures acting on them */
+/* Two representations are supported:
+ *      dense:  the adjacency matrix is a bitset- row v is words consecutive 64 bit words in one buffer, bit i of the row being edge (v, i)
+ *      sparse: every vertex has a vector of neighbours, and a hash set of edges catches repeated additions- O(n+m) memory
+ * All traversals are iterative and take O(n+m) time in sparse mode (O(n*n/64) in dense mode)
+ * main answers graph streams offline with DynamicConnectivity by default; Graph is the online path (--online), and the
+ * reference that DynamicConnectivity is checked against (--check, --selftest) */
 class Graph {
     public:
-    /* The Graph constructor takes the vertex count and initializes the adjacency matrix */
-        Graph(int vertexCount) {
+        enum representation { AUTOMATIC, DENSE, SPARSE };
+
+    /* The Graph constructor takes the vertex count and initializes the adjacency matrix (or lists) */
+    /* AUTOMATIC chooses the bitset only while it takes at most a few megabytes */
+        Graph(int vertexCount, representation r=AUTOMATIC) {
             n=vertexCount;
-            adj=new bool*[n];
-            for(int i=0; i<n; i++) {
-                adj[i]=new bool[n];
-                for(int j=0; j<n; j++)
-                    adj[i][j]=false;
-            }
+            words=(n+63)/64;
+            sparse= r==SPARSE || (r==AUTOMATIC && n>DENSE_LIMIT);
+            if(sparse)
+                neighbours.resize(n);
+            else
+                adj=new uint64_t[(size_t)n*words]();
         }
 
         /* Adding the an edge (i, j) to the adjacency matrix */
         void operator += (pair<int, int> edge) {
-            adj[edge.first][edge.second]=true;
-            adj[edge.second][edge.first]=true;
+            labelled=false;
+            if(!sparse) {
+                setBit(row(edge.first), edge.second);
+                setBit(row(edge.second), edge.first);
+                return;
+            }
+            /* Adding an edge that is already present changes nothing; a self-loop is listed once */
+            if(!edges.insert(edgeKey(edge)).second)
+                return;
+            neighbours[edge.first].push_back(edge.second);
+            if(edge.first!=edge.second)
+                neighbours[edge.second].push_back(edge.first);
         }
 
         /* Adding the an edge (i, j) from the adjacency matrix */
         void operator -= (pair<int, int> edge) {
-            adj[edge.first][edge.second]=false;
-            adj[edge.second][edge.first]=false;
+            labelled=false;
+            if(!sparse) {
+                clearBit(row(edge.first), edge.second);
+                clearBit(row(edge.second), edge.first);
+                return;
+            }
+            if(edges.erase(edgeKey(edge))==0)
+                return;
+            removeNeighbour(edge.first, edge.second);
+            if(edge.first!=edge.second)
+                removeNeighbour(edge.second, edge.first);
         }
 
         /* Returns true if a cycle is present in the graph */
         bool detectCycle() {
             /* Initializing the visited vertex to reflect none of the vertices have been visited */
-            bool visited[n];
-            for(int i=0; i<n; i++)
-                visited[i]=false;
-            
+            vector<uint64_t> visited(words, 0);
+            vector<int> parent(n, -1);
+
             /* Check, for every component, if a cycle is present */
-            for(int i=0; i<n; i++) 
-                if(!visited[i] && dfs_detectCycle(i, -1, visited))
-                    return true;
-            
+            /* A vertex is marked when it is discovered, and remembers the vertex it was discovered from; an edge to any */
+            /* other vertex that is already marked is not an edge of the traversal tree, and so closes a cycle */
+            Stack s;
+            for(int w=0; w<words; w++) {
+                while(~visited[w] & validBits(w)) {
+                    int start=w*64+__builtin_ctzll(~visited[w] & validBits(w));
+                    setBit(visited.data(), start);
+                    s.Push(start);
+
+                    while(!s.isEmpty()) {
+                        int current=s.Pop();
+                        if(hasVisitedNeighbour(current, parent[current], visited.data()))
+                            return true;
+                        pushUnvisited(current, visited.data(), s, parent.data());
+                    }
+                }
+            }
             return false;
         }
 
+        /* Components are counted by labelling every vertex with its component (see label) */
         int components() {
-            /* Initializing the visited vertex to reflect none of the vertices have been visited */
-            bool visited[n];
-            for(int i=0; i<n; i++)
-                visited[i]=false;
-
-            int componentCount=0;
-
-            /* We go through all components here */
-            for(int i=0; i<n; i++) {
-                if(!visited[i]) {
-                    componentCount++;
-                    dfs_components(i, visited);
-                }
-            }
+            label();
             return componentCount;
         }
 
+        /* A single query traverses from u until v turns up, unless the labels are still valid from an earlier query */
         bool reach(int u, int v) {
+            if(labelled)
+                return componentId[u]==componentId[v];
+
             /* Initializing the visited vertex to reflect none of the vertices have been visited */
-            bool visited[n];
-            for(int i=0; i<n; i++)
-                visited[i]=false;
+            vector<uint64_t> visited(words, 0);
 
             /* If u and v are in the same component then there is a path between them */
-            return dfs_reach(u, v, visited);
+            return dfs_reach(u, v, visited.data());
         }
 
-    private:
-        /* Returns true if a back-edge (necessary and sufficient condition for cycle) is detected */
-        bool dfs_detectCycle(int vertex, int parent, bool* visited) {
-            visited[vertex]=true;
-            for(int i=0; i<n; i++)
-                /* Here we check if the edge exists and is incident on a previously visited vertex- not parent */
-                if(adj[vertex][i] && i!=parent && (visited[i] || dfs_detectCycle(i, vertex, visited)))
-                    return true;
-            return false;
+        /* Answers many reach queries at once: after labelling, each one is a comparison of two labels */
+        vector<bool> reach(const vector<pair<int, int> >& pairs) {
+            label();
+            vector<bool> output(pairs.size());
+            for(size_t i=0; i<pairs.size(); i++)
+                output[i]= componentId[pairs[i].first]==componentId[pairs[i].second];
+            return output;
         }
 
-        /* Marks all vertices reachable from the given vertex in a dfs-traversal */
-        void dfs_components(int vertex, bool* visited) {
-            /* The stack s maintains a list of nodes, in which we are currently exploring edges from top node */
-            Stack s;
-            s.Push(vertex);
+        /* Number of threads used for labelling (1 by default) */
+        void setThreads(int threads) {
+            threadCount=max(threads, 1);
+        }
 
-            while(!s.isEmpty()) {
-                /* We consider the top node and mark it as visited */
-                int current=s.Pop();
-                if(visited[current]) continue;
-                visited[current]=true;
+        /* Gives every vertex the smallest vertex of its component as label; the labels stay valid until the next += or -= */
+        /* Threads split the vertices into contiguous blocks and hook the edges of their block into a shared, lock-free union-find */
+        void label();
 
-                /* We add all unvisited neighbours to stack */
-                for(int i=0; i<n; i++)
-                    if(adj[current][i] && !visited[i])
-                        s.Push(i);
-            }
+        ~Graph() {
+            delete[] adj;
         }
 
+    private:
         /* Checks if two vertices belong to the same component */
-        bool dfs_reach(int start, int end, bool* visited) {
-            /* The stack s maintains a list of nodes, in which we are currently exploring edges from top node */
+        bool dfs_reach(int start, int end, uint64_t* visited) {
+            /* The stack s maintains a list of nodes whose edges are still to be explored */
             Stack s;
+            setBit(visited, start);
             s.Push(start);
 
             while(!s.isEmpty()) {
-                /* We consider the top node and mark it as visited */
-                int current=s.Pop();
-                if(visited[current]) continue;
-                visited[current]=true;
-
                 /* Since the current variable iterates through vertices reachable from start, we only test if current==end */
+                int current=s.Pop();
                 if(current==end)
                     return true;
+                pushUnvisited(current, visited, s);
+            }
+            return false;
+        }
 
-                /* We add all unvisited neighbours to stack */
-                for(int i=0; i<n; i++)
-                    if(adj[current][i] && !visited[i])
+        /* We add all unvisited neighbours to stack and mark them (64 candidates at a time in dense mode); */
+        /* if parent is given, the neighbours also remember that they were discovered from vertex */
+        void pushUnvisited(int vertex, uint64_t* visited, Stack& s, int* parent=NULL) {
+            if(sparse) {
+                for(int i: neighbours[vertex]) {
+                    if(!testBit(visited, i)) {
+                        setBit(visited, i);
+                        if(parent!=NULL)
+                            parent[i]=vertex;
                         s.Push(i);
+                    }
+                }
+                return;
+            }
+
+            uint64_t* row=this->row(vertex);
+            for(int w=0; w<words; w++) {
+                uint64_t fresh=row[w] & ~visited[w];
+                visited[w]|=fresh;
+                for(; fresh!=0; fresh&=fresh-1) {
+                    int i=w*64+__builtin_ctzll(fresh);
+                    if(parent!=NULL)
+                        parent[i]=vertex;
+                    s.Push(i);
+                }
+            }
+        }
+
+        /* Returns true if some neighbour of vertex other than skip is marked */
+        bool hasVisitedNeighbour(int vertex, int skip, const uint64_t* visited) {
+            if(sparse) {
+                for(int i: neighbours[vertex])
+                    if(i!=skip && testBit(visited, i))
+                        return true;
+                return false;
+            }
+
+            uint64_t* row=this->row(vertex);
+            for(int w=0; w<words; w++) {
+                uint64_t marked=row[w] & visited[w];
+                if(skip!=-1 && skip/64==w)
+                    marked&=~(1ULL<<(skip%64));
+                if(marked)
+                    return true;
             }
             return false;
         }
 
-        /* n is the number of vertices in the graph, and adj is the adjacency matrix */
-        int n;
-        bool** adj;
+        /* Removes one neighbour from the vector of vertex; order does not matter, so the last entry takes its place */
+        void removeNeighbour(int vertex, int neighbour) {
+            vector<int>& list=neighbours[vertex];
+            for(size_t i=0; i<list.size(); i++) {
+                if(list[i]==neighbour) {
+                    list[i]=list.back();
+                    list.pop_back();
+                    return;
+                }
+            }
+        }
+
+        /* Helpers for the bitsets */
+        uint64_t* row(int vertex) { return adj+(size_t)vertex*words; }
+        static void setBit(uint64_t* bits, int i) { bits[i/64]|=1ULL<<(i%64); }
+        static void clearBit(uint64_t* bits, int i) { bits[i/64]&=~(1ULL<<(i%64)); }
+        static bool testBit(const uint64_t* bits, int i) { return (bits[i/64]>>(i%64))&1; }
+
+        /* Bits of word w that stand for actual vertices */
+        uint64_t validBits(int w) { return w<n/64 ? ~0ULL : (1ULL<<(n%64))-1; }
+
+        /* Key of an undirected edge in the hash set */
+        static long long edgeKey(pair<int, int> edge) {
+            return (long long)min(edge.first, edge.second)<<32 | (unsigned)max(edge.first, edge.second);
+        }
+
+        /* Lock-free union-find: roots are only ever hooked below smaller roots, with compare and swap */
+        int findRoot(int x);
+        void hook(int a, int b);
+
+        /* Calls f(u, v) for every edge with u<v and u in [low, high) */
+        template<class F> void forEachEdge(int low, int high, F f);
+
+        /* Largest vertex count for which AUTOMATIC picks the bitset (2 MB) */
+        static const int DENSE_LIMIT=4096;
+
+        /* n is the number of vertices in the graph, words is the number of words per bitset row, and adj is the adjacency matrix */
+        int n, words;
+        bool sparse;
+        uint64_t* adj=NULL;
+
+        /* Adjacency lists and edge set of sparse mode */
+        vector<vector<int> > neighbours;
+        unordered_set<long long> edges;
+
+        /* Component labels, valid while labelled is true */
+        vector<int> componentId;
+        int componentCount=0;
+        bool labelled=false;
+        int threadCount=1;
+        vector<atomic<int> > parent;
+};
+
+int Graph::findRoot(int x) {
+    /* Path halving: every vertex on the way is pointed at its grandparent; a stale read only makes the step smaller */
+    while(true) {
+        int p=parent[x].load(memory_order_relaxed);
+        if(p==x)
+            return x;
+        int grandparent=parent[p].load(memory_order_relaxed);
+        if(p!=grandparent)
+            parent[x].compare_exchange_weak(p, grandparent, memory_order_relaxed);
+        x=grandparent;
+    }
+}
+
+void Graph::hook(int a, int b) {
+    while(true) {
+        a=findRoot(a);
+        b=findRoot(b);
+        if(a==b)
+            return;
+
+        /* The larger root goes below the smaller one, so no cycle can form; if a stopped being a root meanwhile, try again */
+        if(a<b)
+            swap(a, b);
+        int expected=a;
+        if(parent[a].compare_exchange_strong(expected, b))
+            return;
+    }
+}
+
+template<class F> void Graph::forEachEdge(int low, int high, F f) {
+    for(int u=low; u<high; u++) {
+        if(sparse) {
+            for(int v: neighbours[u])
+                if(u<v)
+                    f(u, v);
+            continue;
+        }
+
+        /* Only the bits after u in the row */
+        uint64_t* row=this->row(u);
+        for(int w=(u+1)/64; w<words; w++) {
+            uint64_t bits=row[w];
+            if(w==(u+1)/64)
+                bits&=~0ULL<<((u+1)%64);
+            for(; bits!=0; bits&=bits-1)
+                f(u, w*64+__builtin_ctzll(bits));
+        }
+    }
+}
+
+void Graph::label() {
+    if(labelled)
+        return;
+
+    parent=vector<atomic<int> >(n);
+    componentId.resize(n);
+    int threads=max(1, min(threadCount, n/1024));
+
+    /* Runs phase(t, low, high) on contiguous blocks of vertices, block t on thread t (the calling thread takes block 0) */
+    auto inParallel=[&](auto phase) {
+        vector<thread> workers;
+        for(int t=1; t<threads; t++)
+            workers.push_back(thread(phase, t, (long long)n*t/threads, (long long)n*(t+1)/threads));
+        phase(0, 0, (long long)n/threads);
+        for(auto& worker: workers)
+            worker.join();
+    };
+
+    inParallel([&](int, int low, int high) {
+        for(int v=low; v<high; v++)
+            parent[v].store(v, memory_order_relaxed);
+    });
+    inParallel([&](int, int low, int high) {
+        forEachEdge(low, high, [&](int u, int v) { hook(u, v); });
+    });
+
+    /* The root of every tree is its smallest vertex, so it doubles as the label */
+    vector<int> roots(threads);
+    inParallel([&](int t, int low, int high) {
+        int count=0;
+        for(int v=low; v<high; v++) {
+            componentId[v]=findRoot(v);
+            count+= componentId[v]==v;
+        }
+        roots[t]=count;
+    });
+
+    componentCount=0;
+    for(int count: roots)
+        componentCount+=count;
+    labelled=true;
+}
+
+/*=================================================================================================
+ *  DynamicConnectivity takes the same stream of operations as Graph, and answers the read queries
+ *  (reach, components, cycle) once the whole stream has been given:
+ *      void add(int u, int v), void del(int u, int v)          => Record an edge change
+ *      void reach(int u, int v), void components(), void cycle() => Record a read query
+ *      vector<int> answers();                                  => Answers of the read queries, in order
+ *  Every edge is present during an interval of read queries. The intervals are spread over a segment
+ *  tree on the read queries, and a depth-first walk of the tree keeps a union-find with rollback of
+ *  exactly the edges present at each leaf; a graph has a cycle iff it has more than n-components edges.
+ *  The total cost is O(m log m log n) for a stream of m operations.
+ * ===============================================================================================*/
+class DynamicConnectivity {
+    public:
+        DynamicConnectivity(int vertexCount): n(vertexCount) {}
+
+        /* Adding an edge that is already present, or deleting one that is absent, changes nothing- same as in Graph */
+        void add(int u, int v) {
+            pair<int, int> edge(min(u, v), max(u, v));
+            if(addedAt.count(edge)==0) {
+                addedAt[edge]=queries.size();
+                edgeCount++;
+            }
+        }
+
+        void del(int u, int v) {
+            auto it=addedAt.find(make_pair(min(u, v), max(u, v)));
+            if(it!=addedAt.end()) {
+                intervals.push_back(interval{it->first.first, it->first.second, it->second, (int)queries.size()});
+                addedAt.erase(it);
+                edgeCount--;
+            }
+        }
+
+        void reach(int u, int v) { queries.push_back(query{REACH, u, v, edgeCount}); }
+        void components() { queries.push_back(query{COMPONENTS, 0, 0, edgeCount}); }
+        void cycle() { queries.push_back(query{CYCLE, 0, 0, edgeCount}); }
+
+        vector<int> answers();
+
+    private:
+        enum kind { REACH, COMPONENTS, CYCLE };
+
+        /* A read query, with the number of edges present when it was made */
+        struct query {
+            kind type;
+            int u, v, edges;
+        };
+
+        /* Edge (u, v) is present for the read queries in [first, last) */
+        struct interval {
+            int u, v, first, last;
+        };
+
+        void insert(int node, int low, int high, const interval& e);
+        void walk(int node, int low, int high, vector<int>& output);
+
+        /* Union by size without path compression, so every union can be undone */
+        int find(int x) {
+            while(parent[x]!=x)
+                x=parent[x];
+            return x;
+        }
+        void unite(int a, int b) {
+            a=find(a);
+            b=find(b);
+            if(a==b)
+                return;
+            if(size[a]<size[b])
+                swap(a, b);
+            parent[b]=a;
+            size[a]+=size[b];
+            componentCount--;
+            history.push_back(b);
+        }
+        void rollback(size_t mark) {
+            while(history.size()>mark) {
+                int b=history.back();
+                history.pop_back();
+                size[parent[b]]-=size[b];
+                parent[b]=b;
+                componentCount++;
+            }
+        }
+
+        int n, edgeCount=0, componentCount=0;
+        vector<query> queries;
+        vector<interval> intervals;
+        map<pair<int, int>, int> addedAt;
+        vector<vector<pair<int, int> > > tree;
+        vector<int> parent, size, history;
+};
+
+/* Puts edge e on the O(log m) segment tree nodes that exactly cover its interval */
+void DynamicConnectivity::insert(int node, int low, int high, const interval& e) {
+    if(e.last<=low || high<=e.first)
+        return;
+    if(e.first<=low && high<=e.last) {
+        tree[node].push_back(make_pair(e.u, e.v));
+        return;
+    }
+    int middle=(low+high)/2;
+    insert(2*node, low, middle, e);
+    insert(2*node+1, middle, high, e);
+}
+
+/* On the way down, the edges of every node are united; on the way back up, they are rolled back */
+void DynamicConnectivity::walk(int node, int low, int high, vector<int>& output) {
+    size_t mark=history.size();
+    for(auto& edge: tree[node])
+        unite(edge.first, edge.second);
+
+    if(high-low==1) {
+        query& q=queries[low];
+        if(q.type==REACH)
+            output[low]= find(q.u)==find(q.v);
+        else if(q.type==COMPONENTS)
+            output[low]=componentCount;
+        else
+            output[low]= q.edges>n-componentCount;
+    } else {
+        int middle=(low+high)/2;
+        walk(2*node, low, middle, output);
+        walk(2*node+1, middle, high, output);
+    }
+    rollback(mark);
+}
+
+vector<int> DynamicConnectivity::answers() {
+    int Q=queries.size();
+    vector<int> output(Q);
+    if(Q==0)
+        return output;
+
+    /* Edges never deleted stay until the end of the stream */
+    vector<interval> all(intervals);
+    for(auto& it: addedAt)
+        all.push_back(interval{it.first.first, it.first.second, it.second, Q});
+
+    tree.assign(4*Q, vector<pair<int, int> >());
+    for(auto& e: all)
+        insert(1, 0, Q, e);
+
+    parent.resize(n);
+    size.assign(n, 1);
+    for(int i=0; i<n; i++)
+        parent[i]=i;
+    componentCount=n;
+    history.clear();
+
+    walk(1, 0, Q, output);
+    return output;
+}
+
+/* One operation of a graph stream: add, del or reach with vertices u and v, or components or cycle */
+struct operation {
+    string type;
+    int u=0, v=0;
 };
 
-int main() {
+/* Answers of the read queries of a stream, from a Graph that follows the stream and answers each query as it comes */
+vector<int> answerOnline(int n, const vector<operation>& ops, Graph::representation r, int threads) {
+    Graph g(n, r);
+    g.setThreads(threads);
+    vector<int> answers;
+    for(const operation& op: ops) {
+        if(op.type=="add")
+            g+= pair<int, int>(op.u, op.v);
+        else if(op.type=="del")
+            g-= pair<int, int>(op.u, op.v);
+        else if(op.type=="cycle")
+            answers.push_back(g.detectCycle());
+        else if(op.type=="components")
+            answers.push_back(g.components());
+        else
+            answers.push_back(g.reach(op.u, op.v));
+    }
+    return answers;
+}
+
+/* Answers of the read queries of a stream, from DynamicConnectivity once the whole stream is recorded */
+vector<int> answerOffline(int n, const vector<operation>& ops) {
+    DynamicConnectivity engine(n);
+    for(const operation& op: ops) {
+        if(op.type=="add")
+            engine.add(op.u, op.v);
+        else if(op.type=="del")
+            engine.del(op.u, op.v);
+        else if(op.type=="cycle")
+            engine.cycle();
+        else if(op.type=="components")
+            engine.components();
+        else
+            engine.reach(op.u, op.v);
+    }
+    return engine.answers();
+}
+
+/* Runs random streams through DynamicConnectivity and through a dense and a sparse Graph, and reports the streams */
+/* where they disagree on cerr. Stream k uses seed k; a few streams have enough vertices for several labelling threads */
+bool selfTest(int streams, int threads) {
+    const char* types[]={"add", "add", "add", "del", "del", "reach", "components", "cycle"};
+    int failures=0;
+    for(int k=0; k<streams; k++) {
+        mt19937 random(k);
+        int n= k%10==9 ? 2048+random()%2048 : 1+random()%64;
+        int m=1+random()%2000;
+        vector<operation> ops(m);
+        for(operation& op: ops) {
+            op.type=types[random()%8];
+            op.u=random()%n;
+            op.v= random()%16==0 ? op.u : random()%n;
+        }
+        vector<int> offline=answerOffline(n, ops);
+        if(offline!=answerOnline(n, ops, Graph::DENSE, threads) || offline!=answerOnline(n, ops, Graph::SPARSE, threads)) {
+            cerr<<"Self-test stream "<<k<<" (n="<<n<<", m="<<m<<"): DynamicConnectivity and Graph disagree"<<endl;
+            failures++;
+        }
+    }
+    cerr<<"Self-test: "<<streams-failures<<" of "<<streams<<" random streams agree"<<endl;
+    return failures==0;
+}
+
+int main(int argc, char** argv) {
+    /* Read queries are answered by DynamicConnectivity after the whole graph stream is read, or with --online by a Graph */
+    /* as they come. With --check, the stream is also run on a Graph, and any answer that differs is reported on cerr */
+    /* --dense or --sparse picks the representation of that Graph (by default it depends on the vertex count) */
+    /* --threads T (or --threads=T) labels its components with T threads */
+    /* --selftest N compares both paths on N random streams, instead of reading any input */
+    bool check=false, online=false;
+    int selftest=0;
+    Graph::representation r=Graph::AUTOMATIC;
+    int threads=1;
+    for(int i=1; i<argc; i++) {
+        if(strcmp(argv[i], "--check")==0)
+            check=true;
+        else if(strcmp(argv[i], "--online")==0)
+            online=true;
+        else if(strcmp(argv[i], "--selftest")==0 && i+1<argc)
+            selftest=atoi(argv[++i]);
+        else if(strcmp(argv[i], "--dense")==0)
+            r=Graph::DENSE;
+        else if(strcmp(argv[i], "--sparse")==0)
+            r=Graph::SPARSE;
+        else if(strcmp(argv[i], "--threads")==0 && i+1<argc)
+            threads=atoi(argv[++i]);
+        else if(strncmp(argv[i], "--threads=", 10)==0)
+            threads=atoi(argv[i]+10);
+    }
+    if(selftest>0)
+        return selfTest(selftest, threads) ? 0 : 1;
+
     /* Read in number of stack queries */
     int Q; cin>>Q;
 
@@ -211,27 +696,20 @@ int main() {
 
     /* Read in number of vertices and graph queries */
     int n, m; cin>>n>>m;
-
-    /* Create graph object */
-    Graph g(n);
+    vector<operation> ops(m);
     for(int i=0; i<m; i++) {
-        /* Read in input */
-        string input; cin>>input;
+        cin>>ops[i].type;
+        if(ops[i].type!="cycle" && ops[i].type!="components")
+            cin>>ops[i].u>>ops[i].v;
+    }
 
-        /* Perform relevant operation */
-        if(input.compare("add")==0) {
-            int u, v; cin>>u>>v;
-            g+= pair<int, int>(u, v);
-        } else if(input.compare("del")==0) {
-            int u, v; cin>>u>>v;
-            g-= pair<int, int>(u, v);
-        } else if(input.compare("cycle")==0) {
-            cout<<(g.detectCycle())<<endl;
-        } else if(input.compare("components")==0) {
-            cout<<(g.components())<<endl;
-        } else {
-            int u, v; cin>>u>>v;
-            cout<<(g.reach(u, v))<<endl;
-        }
+    vector<int> output= online ? answerOnline(n, ops, r, threads) : answerOffline(n, ops);
+    vector<int> expected;
+    if(check)
+        expected=answerOnline(n, ops, r, threads);
+    for(size_t i=0; i<output.size(); i++) {
+        cout<<output[i]<<endl;
+        if(check && output[i]!=expected[i])
+            cerr<<"Mismatch on read query "<<i<<": expected "<<expected[i]<<", got "<<output[i]<<endl;
     }
 }
@@ -1,62 +1,322 @@
 #include<iostream>
+#include<vector>
+#include<cstdint>
+#include<algorithm>
+#include<cmath>
+#include<thread>
+#include<cstring>
+#include<cstdlib>
+#include<climits>
+#include<cctype>
+#include<string>
 using namespace std;
 int max(int a, int b, int c) {return max(max(a, b), c);}
 
+/*=========================================================================================================================================================
+ * The class InversionCounter keeps the number of inversions among the active positions 0, ..., n-1 (pairs i<j with value[i]>value[j]):
+ *      InversionCounter(int n);                            => All positions start inactive
+ *      long long inversions();                             => Returns the current count
+ *      bool holds(int i, bool active, int value);          => Checks if position i already is as given
+ *      void set(int i, bool active, int value);            => Changes position i and updates the count (O(sqrt(n log n)))
+ *      void stage(int i, bool active, int value);          => Changes position i without updating the count...
+ *      void recount();                                     => ...which is then counted from scratch, for many changes at once (O(n log n))
+ *      double setCost();                                   => Estimated cost of one set, in merge steps of a recount
+ *      void setThreads(int threads);                       => Number of threads a recount runs on (1 by default)
+ *
+ * The positions are cut into blocks, each keeping its active values sorted: the inversions a position takes part in are then
+ * found by binary search in the other blocks and by a scan of its own. A recount sorts the blocks in parallel, then merges
+ * them level by level, every level's output being cut into equal pieces (one per thread) along the merge paths
+ * =======================================================================================================================================================*/
+class InversionCounter {
+    public:
+        InversionCounter(int n): n(n), value(n, 0), active(n, 0) {
+            /* Blocks of about sqrt(n log n) positions balance the binary searches against the scan */
+            blockSize=max(64, (int)sqrt(n*log2(n+1.0)));
+            blocks.resize((n+blockSize-1)/blockSize);
+        }
+
+        long long inversions() {
+            return total;
+        }
+
+        bool holds(int i, bool active, int value) {
+            return this->active[i]==active && (!active || this->value[i]==value);
+        }
+
+        void set(int i, bool active, int value) {
+            vector<int>& block=blocks[i/blockSize];
+            if(this->active[i]) {
+                total-=pairsWith(i, this->value[i]);
+                block.erase(lower_bound(block.begin(), block.end(), this->value[i]));
+            }
+            this->active[i]=active;
+            this->value[i]=value;
+            if(active) {
+                total+=pairsWith(i, value);
+                block.insert(upper_bound(block.begin(), block.end(), value), value);
+            }
+        }
+
+        void stage(int i, bool active, int value) {
+            this->active[i]=active;
+            this->value[i]=value;
+        }
+
+        /* Merge sort of the active values, split at block boundaries first: once each block is sorted (and its own */
+        /* inversions counted) it is copied out, and merging the blocks counts the inversions between them */
+        void recount() {
+            array.clear();
+            temp.resize(n);
+            vector<int> starts;
+            for(int i=0; i<n; i++) {
+                if(i%blockSize==0)
+                    starts.push_back(array.size());
+                if(active[i])
+                    array.push_back(value[i]);
+            }
+            starts.push_back(array.size());
+
+            /* Each thread sorts a range of whole blocks */
+            int size=array.size(), blockCount=blocks.size();
+            int threads=max(1, min(threadCount, size/ELEMENTS_PER_THREAD));
+            vector<long long> partial(threads, 0);
+            parallel(threads, [&](int t) {
+                for(int b=(long long)blockCount*t/threads; b<(long long)blockCount*(t+1)/threads; b++) {
+                    partial[t]+=inversions(array.data(), temp.data(), starts[b], starts[b+1]);
+                    blocks[b].assign(array.begin()+starts[b], array.begin()+starts[b+1]);
+                }
+            });
+
+            /* Runs are merged in pairs from one buffer into the other; thread t writes output positions */
+            /* [size*t/threads, size*(t+1)/threads) of a level, whichever runs they fall in */
+            int *from=array.data(), *to=temp.data();
+            while(starts.size()>2) {
+                parallel(threads, [&](int t) {
+                    int first=(long long)size*t/threads, last=(long long)size*(t+1)/threads;
+                    for(size_t r=0; r+1<starts.size(); r+=2) {
+                        int low=starts[r], mid=starts[min(r+1, starts.size()-1)], high=starts[min(r+2, starts.size()-1)];
+                        if(high>first && low<last)
+                            partial[t]+=merge(from, to, low, mid, high, max(low, first), min(high, last));
+                    }
+                });
+                vector<int> next;
+                for(size_t r=0; r<starts.size(); r+=2)
+                    next.push_back(starts[r]);
+                if(next.back()!=size)
+                    next.push_back(size);
+                starts.swap(next);
+                swap(from, to);
+            }
+
+            total=0;
+            for(long long count: partial)
+                total+=count;
+        }
+
+        /* Heuristic: a set is taken to cost n/blockSize binary searches plus a scan of blockSize positions, with no */
+        /* constant factor (for n=1e6 this puts the crossover with a recount near 2800 changed rooms; about 2600 was timed) */
+        double setCost() {
+            return n/blockSize*log2(blockSize)+blockSize;
+        }
+
+        void setThreads(int threads) {
+            threadCount=max(threads, 1);
+        }
+
+    private:
+        /* Number of active positions other than i that form an inversion with value v at position i: */
+        /* larger values before it and smaller values after it */
+        long long pairsWith(int i, int v) {
+            long long count=0;
+            int own=i/blockSize;
+            for(int b=0; b<own; b++)
+                count+=blocks[b].end()-upper_bound(blocks[b].begin(), blocks[b].end(), v);
+            for(size_t b=own+1; b<blocks.size(); b++)
+                count+=lower_bound(blocks[b].begin(), blocks[b].end(), v)-blocks[b].begin();
+            for(int j=own*blockSize; j<i; j++)
+                count+= active[j] && value[j]>v;
+            for(int j=i+1; j<min(n, (own+1)*blockSize); j++)
+                count+= active[j] && value[j]<v;
+            return count;
+        }
+
+        /* Runs f(0), ..., f(threads-1) at the same time; the calling thread takes f(0) itself */
+        template<class F>
+        static void parallel(int threads, F f) {
+            vector<thread> workers;
+            for(int t=1; t<threads; t++)
+                workers.push_back(thread(f, t));
+            f(0);
+            for(auto& worker: workers)
+                worker.join();
+        }
+
+        /* Sorts 'array' and returns original number of inversions */
+        static long long inversions(int* array, int* temp, int low, int high) {
+            /* Short segments are insertion sorted: every step a value moves left undoes exactly one inversion */
+            if(high-low<=INSERTION_CUTOFF) {
+                long long inversionCount=0;
+                for(int i=low+1; i<high; i++) {
+                    int v=array[i], j=i;
+                    for(; j>low && array[j-1]>v; j--)
+                        array[j]=array[j-1];
+                    array[j]=v;
+                    inversionCount+=i-j;
+                }
+                return inversionCount;
+            }
+
+            /* We sort left and right segments and store the corresponding number of inversions */
+            int mid=low+(high-low)/2;
+            long long inversionCount=inversions(array, temp, low, mid) + inversions(array, temp, mid, high);
+
+            /* Store 'array' in a temporary array, and merge it back */
+            for(int i=low; i<high; i++)
+                temp[i]=array[i];
+            return inversionCount + merge(temp, array, low, mid, high, low, high);
+        }
+
+        /* Writes positions [first, last) of the merge of the sorted segments [low, mid) and [mid, high) of 'from' into 'to', */
+        /* and returns the inversions between the segments that are found meanwhile */
+        static long long merge(const int* from, int* to, int low, int mid, int high, int first, int last) {
+            /* The d=first-low outputs before 'first' take the smallest k values of the left segment and d-k of the right: */
+            /* k is found by binary search along the merge path (on ties the left value goes first) */
+            int d=first-low, l=max(0, d-(high-mid)), r=min(d, mid-low);
+            while(l<r) {
+                int k=(l+r)/2;
+                if(from[low+k]<=from[mid+d-k-1])
+                    l=k+1;
+                else
+                    r=k;
+            }
+            int p1=low+l, p2=mid+d-l;
+
+            /* We can merge the left and right segments by selecting the smaller number from the small ends of each segment */
+            /* if from[p1]>from[p2], then the elements after from[p1] in the left segment are also greater than from[p2] */
+            /* Accordingly, we can update the inversion count */
+            long long inversionCount=0;
+            for(int p=first; p<last; p++) {
+                if(p1<mid && (p2>=high || from[p1]<=from[p2])) {
+                    to[p]=from[p1++];
+                } else {
+                    to[p]=from[p2++];
+                    inversionCount+= mid-p1;
+                }
+            }
+            return inversionCount;
+        }
+
+        /* Segments up to this long are insertion sorted, and threads are only used for at least this many values each */
+        static const int INSERTION_CUTOFF=16;
+        static const int ELEMENTS_PER_THREAD=1<<15;
+
+        int n, blockSize;
+        long long total=0;
+        vector<int> value;              // value of each position
+        vector<char> active;            // whether each position counts
+        vector<vector<int> > blocks;    // sorted active values of each block
+        vector<int> array, temp;        // merge sort buffers of a recount
+        int threadCount=1;
+};
+
 /*=========================================================================================================================================================
  * The class BloomBrain implements the following public functions:
- *      BloomBrain(int roomCount);              => Allocates memory for an array of seraphic numbers and an array to determine whether an element is empty
- *      long long update(int* sublimity);       => Updates the seraphic numbers array
- *      int play();                             => Finds the minimum seraphic number to guarantee a win against any group
+ *      BloomBrain(int roomCount);              => Allocates memory for an array of seraphic numbers and an index of the empty rooms
+ *      long long update(int* sublimity);       => Updates the seraphic numbers array (only the changed rooms are recounted)
+ *      int play();                             => Finds the minimum seraphic number to guarantee a win against any group (O(1))
+ *      int play(int l, int r);                 => The same, for groups within rooms [l, r) only (O(log n)); INT_MIN if there are none
  *      void leave(int roomNumber);             => Empties the given room
- *      void join(int seraphic);                => Adds a person with the given seraphic number
+ *      void join(int seraphic);                => Adds a person with the given seraphic number (O(log64 n))
  *      int occupied();                         => Prints number of occupied rooms
+ *      void setThreads(int threads);           => Number of threads for counting inversions from scratch (1 by default)
+ *
+ * The max-subarray summaries of the rooms are kept in a segment tree, so leave and join cost O(log n)
  * =======================================================================================================================================================*/
 class BloomBrain {
     public:
-        /* Allocates memory for the two described arrays, and initializes emptiness array */
-        BloomBrain(int roomCount): n(roomCount), occupancy(roomCount) {
-            a=new int[n];
-            empty=new bool[n];
+        /* Allocates memory for the seraphic numbers and the emptiness index */
+        BloomBrain(int roomCount): n(roomCount), occupancy(roomCount), counter(roomCount) {
+            a=new int[n]();
+            tree=new quad[max(2*n-1, 1)];
+
+            /* Initially, all rooms are occupied: every level of the index is all zeros, down to a single top word */
+            size_t words=(n+63)/64;
+            do {
+                words=max(words, (size_t)1);
+                empty.push_back(vector<uint64_t>(words, 0));
+                words=(words+63)/64;
+            } while(empty.back().size()>1);
+            build(0, 0, n);
+        }
 
-            /* Initially, all rooms are occupied */
-            for(int i=0; i<n; i++)
-                empty[i]=false;
+        ~BloomBrain() {
+            delete[] a;
+            delete[] tree;
         }
 
         /* Updates the seraphic numbers of people, and finds the number of quality conversations */
         /* The number of quality conversations is equal to the number of inversions */
         long long update(int* sublimity) {
-            /* We take the non-empty rooms into consideration to find number of quality conversations */
-            int array[n], temp[n], p=0;
+            /* Find the rooms whose seraphic number changed, and those the counter has a different value or emptiness for */
+            vector<int> changed, recount;
             for(int i=0; i<n; i++) {
+                if(a[i]!=sublimity[i])
+                    changed.push_back(i);
                 a[i]=sublimity[i];
-                if(!empty[i])
-                    array[p++]=a[i];
+                if(!counter.holds(i, !isEmpty(i), a[i]))
+                    recount.push_back(i);
+            }
+
+            /* The segment tree is patched room by room unless rebuilding it is cheaper */
+            if(changed.size()*log2(n+1.0)>n)
+                build(0, 0, n);
+            else
+                for(int i: changed)
+                    modify(0, 0, n, i);
+
+            /* Likewise each changed room costs the counter a few binary searches per block; if that adds up to more than */
+            /* counting from scratch, the non-empty rooms are recounted with a merge sort */
+            if(recount.size()*counter.setCost()>n*log2(n+1.0)) {
+                for(int i=0; i<n; i++)
+                    counter.stage(i, !isEmpty(i), a[i]);
+                counter.recount();
+            } else {
+                for(int i: recount)
+                    counter.set(i, !isEmpty(i), a[i]);
             }
-            /* The solution is the number of inversions in [0, p) */
-            return inversions(array, temp, 0, p);
+            return counter.inversions();
         }
 
         /* The best seraphic number of a group is the maximum subarray value */
         int play() {
-            return maxSubarray(0, n).ms;
+            return tree[0].ms;
+        }
+
+        /* The best seraphic number of a group within rooms [l, r), which is cut down to the rooms that exist; */
+        /* if nothing is left there is no group, and the result is INT_MIN (callers should check the range first) */
+        int play(int l, int r) {
+            l=max(l, 0);
+            r=min(r, n);
+            if(l>=r)
+                return INT_MIN;
+            return query(0, 0, n, l, r).ms;
         }
 
         /* Updates the emptiness array and seraphic numbers array, and decrements occupancy */
         void leave(int roomNumber) {
             a[roomNumber]=0;
-            empty[roomNumber]=true;
+            setEmpty(roomNumber, true);
+            modify(0, 0, n, roomNumber);
             occupancy--;
         }
 
         /* Inserts a given seraphic number at first empty spot from end of array, and increments occupancy */
         void join(int seraphic) {
-            for(int i=n-1; i>=0; i--) {
-                if(empty[i]) {
-                    a[i]=seraphic;
-                    empty[i]=false;
-                    break;
-                }
+            int i=lastEmpty();
+            if(i>=0) {
+                a[i]=seraphic;
+                setEmpty(i, false);
+                modify(0, 0, n, i);
             }
             occupancy++;
         }
@@ -66,6 +326,10 @@ class BloomBrain {
             return occupancy;
         }
 
+        void setThreads(int threads) {
+            counter.setThreads(threads);
+        }
+
     private:
         /* In quad structure:  
                 ts: total sum of segment
@@ -75,6 +339,7 @@ class BloomBrain {
         */
         struct quad {
             int ts, ps, ss, ms;
+            quad() {}
             quad(int in1, int in2, int in3, int in4): ts(in1), ps(in2), ss(in3), ms(in4) {}
         };
 
@@ -85,60 +350,117 @@ class BloomBrain {
             suffix sum= max(right(suffix sum), right(total sum)+left(suffix sum))
             maximum subarray sum=max(left(maxSum), (right)maxSum, left(suffix sum)+right(prefix sum))
         */
-        quad maxSubarray(int low, int high) {
-            if(high<=low+1)
-                return quad(a[low], a[low], a[low], a[low]);
-            quad l=maxSubarray(low, (low+high)/2), r=maxSubarray((low+high)/2, high);
+        static quad combine(const quad& l, const quad& r) {
             return quad(l.ts + r.ts, max(l.ps, l.ts+r.ps), max(r.ss, r.ts+l.ss), max(l.ms, r.ms, l.ss+r.ps));
         }
 
-        /* Sorts 'array' and returns original number of inversions */
-        long long inversions(int* array, int* temp, int low, int high) {
-            /* Array is already sorted and there are no inversions if there is only one element */
-            if((high-low)<=1)
-                return 0;
+        /* The quads of all segments of the divide and conquer are kept in 'tree', so a change to one room only redoes the */
+        /* segments containing it. Node v holds segment [low, high); its halves [low, mid) and [mid, high) are at nodes v+1 and */
+        /* v+2(mid-low), which takes exactly 2n-1 nodes */
+        void build(int v, int low, int high) {
+            if(high<=low+1) {
+                if(low<n)
+                    tree[v]=quad(a[low], a[low], a[low], a[low]);
+                return;
+            }
+            int mid=(low+high)/2;
+            build(v+1, low, mid);
+            build(v+2*(mid-low), mid, high);
+            tree[v]=combine(tree[v+1], tree[v+2*(mid-low)]);
+        }
 
-            /* Number of elements in left and right subarrays */
-            int n1=(high-low)/2, n2=(1+high-low)/2;
+        /* Combines the quads of the segments that make up [l, r) within [low, high) */
+        /* A segment outside [l, r) gives the empty quad, whose sums can never be the best */
+        quad query(int v, int low, int high, int l, int r) {
+            if(r<=low || high<=l || l>=r)
+                return quad(0, INT_MIN/4, INT_MIN/4, INT_MIN/4);
+            if(l<=low && high<=r)
+                return tree[v];
+            int mid=(low+high)/2;
+            if(r<=mid)
+                return query(v+1, low, mid, l, r);
+            if(l>=mid)
+                return query(v+2*(mid-low), mid, high, l, r);
+            return combine(query(v+1, low, mid, l, r), query(v+2*(mid-low), mid, high, l, r));
+        }
 
-            /* We sort left and right segments and store the corresponding number of inversions */
-            long long inversionCount=inversions(array, temp, low, low+n1) + inversions(array, temp, low+n1, high);
+        /* Redoes the segments on the path to the leaf of room i */
+        void modify(int v, int low, int high, int i) {
+            if(high<=low+1) {
+                tree[v]=quad(a[i], a[i], a[i], a[i]);
+                return;
+            }
+            int mid=(low+high)/2;
+            if(i<mid)
+                modify(v+1, low, mid, i);
+            else
+                modify(v+2*(mid-low), mid, high, i);
+            tree[v]=combine(tree[v+1], tree[v+2*(mid-low)]);
+        }
 
-            /* Store 'array' in a temporary array */
-            for(int i=low; i<high; i++)
-                temp[i]=array[i];
+        /* Bit i of level 0 of the index is set if room i is empty, and bit j of level k+1 if word j of level k is non-zero */
+        bool isEmpty(int i) {
+            return empty[0][i/64]>>(i%64)&1;
+        }
 
-            /* We can merge the left and right segments by selecting the smaller number from the small ends of each segment */
-            /* if temp[in1]>temp[in2], then the elements after temp[in1] in the left segment are also greater than temp[in2] */
-            /* Accordingly, we can update the inversion count */
-            int p1=0, p2=0, p=0;
-            while(p1<n1 || p2<n2) {
-                if(p1<n1 && (p2>=n2 || temp[low+p1]<=temp[low+n1+p2])) {
-                    array[low+p++]=temp[low+p1++];
-                } else {
-                    array[low+p++]=temp[low+n1+p2++];
-                    inversionCount+= n1-p1;
-                }
+        /* Sets or clears the bit of room i, and those of the summary words above it until one of them stays (non-)zero */
+        void setEmpty(int i, bool isEmpty) {
+            for(size_t level=0; level<empty.size(); level++, i/=64) {
+                uint64_t& word=empty[level][i/64];
+                bool wasEmpty= word==0;
+                if(isEmpty)
+                    word|=1ULL<<(i%64);
+                else
+                    word&=~(1ULL<<(i%64));
+                if(wasEmpty==(word==0))
+                    return;
             }
+        }
 
-            return inversionCount;
+        /* Highest-numbered empty room (-1 if none): from the top word down, follow the highest set bit of each level */
+        int lastEmpty() {
+            if(empty.back()[0]==0)
+                return -1;
+            size_t i=0;
+            for(size_t level=empty.size(); level-->0; )
+                i=64*i+63-__builtin_clzll(empty[level][i]);
+            return i;
         }
 
         int* a;         // seraphic numbers array
-        bool* empty;    // emptiness array
+        vector<vector<uint64_t> > empty;    // emptiness index (64-ary hierarchical bitset)
         int n;          // number of rooms
         int occupancy;  // number of occupied rooms
+        quad* tree;     // max-subarray summaries of the segments
+        InversionCounter counter;   // inversions among the non-empty rooms, as of the last update
 };
 
-int main(){
+/* Skips whitespace, and tells if the next token is a number */
+bool numberNext() {
+    cin>>ws;
+    int c=cin.peek();
+    return isdigit(c) || c=='-';
+}
+
+int main(int argc, char** argv){
+    /* The number of threads used to count inversions from scratch can be given as --threads T (or --threads=T) */
+    int threads=1;
+    for(int i=1; i<argc; i++) {
+        if(strcmp(argv[i], "--threads")==0 && i+1<argc)
+            threads=atoi(argv[++i]);
+        else if(strncmp(argv[i], "--threads=", 10)==0)
+            threads=atoi(argv[i]+10);
+    }
+
     /* Read in room count and number of queries */
     int N, Q; cin>>N>>Q;
 
     /* Create a BloomBrain instance on N rooms */
     BloomBrain institute(N);
+    institute.setThreads(threads);
 
     /* Maintain this array to store seraphic numbers */
-    int sublimity[N];
+    vector<int> sublimity(N);
 
     /* Process each query */
     for(int i=0; i<Q; i++) {
@@ -146,9 +468,24 @@ int main(){
         if(input.compare("update")==0) {
             for(int j=0; j<N; j++)
                 cin>>sublimity[j];
-            cout<<institute.update(sublimity)<<endl;
+            cout<<institute.update(sublimity.data())<<endl;
         } else if(input.compare("play")==0) {
-            cout<<institute.play()<<endl;
+            /* "play l r" asks about rooms [l, r) only: no command starts with a digit or '-', so a number after "play" */
+            /* starts a range. A range needs both ends and some room inside [0, N), or it is rejected */
+            if(!numberNext()) {
+                cout<<institute.play()<<endl;
+                continue;
+            }
+            int l, r; cin>>l;
+            if(!numberNext()) {
+                cout<<"INVALID RANGE"<<endl;
+                continue;
+            }
+            cin>>r;
+            if(max(l, 0)>=min(r, N))
+                cout<<"INVALID RANGE"<<endl;
+            else
+                cout<<institute.play(l, r)<<endl;
         } else if(input.compare("leave")==0) {
             int idx; cin>>idx;
             institute.leave(idx);